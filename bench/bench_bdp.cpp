@@ -0,0 +1,138 @@
+//=====================================================================
+//
+// bench_bdp.cpp - bulk throughput over a high bandwidth-delay link
+//
+// Two Kcpp endpoints are driven in virtual time over a simulated
+// 1 Gbit/s, 100 ms rtt link, for several window sizes.
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    // one direction of the link, times are in microseconds
+    class Link
+    {
+    public:
+        Link(double mbps, uint64_t delay, uint64_t queue, double loss)
+            : bytes_per_us_(mbps / 8.0), delay_(delay), queue_(queue), loss_(loss), busy_(0)
+        {
+        }
+
+        void send(uint64_t now, const char *buf, int len)
+        {
+            if (busy_ < now)
+                busy_ = now;
+            if ((busy_ - now) * bytes_per_us_ > queue_) // drop tail
+                return;
+            if (loss_ > 0 && rand() < loss_ * RAND_MAX)
+                return;
+            busy_ += static_cast<uint64_t>(len / bytes_per_us_) + 1;
+            packets_.push_back({busy_ + delay_, std::string(buf, len)});
+        }
+
+        template <typename F>
+        void deliver(uint64_t now, F &&input)
+        {
+            while (!packets_.empty() && packets_.front().first <= now)
+            {
+                input(packets_.front().second);
+                packets_.pop_front();
+            }
+        }
+
+    private:
+        double bytes_per_us_;
+        uint64_t delay_, queue_;
+        double loss_;
+        uint64_t busy_;
+        std::deque<std::pair<uint64_t, std::string>> packets_;
+    };
+
+    struct Peer
+    {
+        Link *link;
+        uint64_t *now;
+    };
+
+    int link_output(const char *buf, int len, Kcpp *, void *user)
+    {
+        Peer *peer = static_cast<Peer *>(user);
+        peer->link->send(*peer->now, buf, len);
+        return 0;
+    }
+
+    void run(int wnd, int wscale, double loss, uint32_t seconds)
+    {
+        const double mbps = 1000.0;
+        const uint64_t delay = 50000; // one way, us
+        uint64_t now = 0;
+
+        Link l12(mbps, delay, 16 << 20, loss), l21(mbps, delay, 16 << 20, loss);
+        Peer p1{&l12, &now}, p2{&l21, &now};
+
+        Kcpp kcp1(0x11223344, &p1), kcp2(0x11223344, &p2);
+        kcp1.set_output(link_output);
+        kcp2.set_output(link_output);
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(1, 10, 2, true);
+        kcp1.set_wndsize(wnd, wnd);
+        kcp2.set_wndsize(wnd, wnd);
+        kcp1.set_wndscale(wscale);
+        kcp2.set_wndscale(wscale);
+
+        std::vector<char> msg(64 * 1024, 'k');
+        std::vector<char> buffer(1024 * 1024);
+        uint64_t received = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t ms = 0; ms < seconds * 1000; ms++)
+        {
+            now = static_cast<uint64_t>(ms) * 1000;
+
+            l12.deliver(now, [&](const std::string &pkt) { kcp2.input(pkt.data(), pkt.size()); });
+            l21.deliver(now, [&](const std::string &pkt) { kcp1.input(pkt.data(), pkt.size()); });
+
+            while (kcp1.wait_send_size() < 2 * wnd)
+            {
+                kcp1.send(msg.data(), static_cast<int>(msg.size()));
+            }
+
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                received += hr;
+            }
+
+            kcp1.update(ms);
+            kcp2.update(ms);
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double goodput = received * 8.0 / seconds / 1e6;
+        printf("wnd=%d wscale=%d loss=%.3f%% goodput_mbps=%.1f utilization=%.1f%% wall_s=%.2f\n",
+               wnd, wscale, loss * 100, goodput, goodput / mbps * 100, wall);
+    }
+}
+
+int main()
+{
+    const int wnds[] = {128, 1024, 4096, 8192, 16384};
+    for (int wnd : wnds)
+    {
+        run(wnd, 0, 0.0, 10);
+    }
+    run(16384, 2, 0.0, 10);
+    run(16384, 2, 0.001, 10);
+    return 0;
+}
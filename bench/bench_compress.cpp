@@ -0,0 +1,214 @@
+//=====================================================================
+//
+// bench_compress.cpp - message compression ratio and cpu cost
+//
+// Measures the lz codec alone on JSON-like, protobuf-like and random
+// messages, then the same messages through a pair of Kcpp endpoints
+// with and without KCP_OPT_COMPRESS.
+//
+//=====================================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+#include "lz.h"
+
+using namespace stone;
+
+namespace
+{
+    const int MESSAGES = 20000;
+
+    std::string json_message(int i)
+    {
+        static const char *names[] = {"alice", "bob", "carol", "dave", "eve"};
+        char buf[512];
+        std::string msg = "[";
+        for (int k = 0; k < 4; k++)
+        {
+            snprintf(buf, sizeof(buf),
+                     "{\"id\":%d,\"name\":\"%s\",\"pos\":{\"x\":%.2f,\"y\":%.2f,\"z\":%.2f},"
+                     "\"hp\":%d,\"state\":\"%s\",\"tags\":[\"player\",\"team_%d\"]},",
+                     i * 4 + k, names[rand() % 5], rand() % 10000 / 100.0, rand() % 10000 / 100.0,
+                     rand() % 10000 / 100.0, rand() % 100, (rand() & 1) ? "moving" : "idle", rand() % 4);
+            msg += buf;
+        }
+        msg.back() = ']';
+        return msg;
+    }
+
+    // tag, varint and short string fields, like a serialized protobuf
+    std::string proto_message(int i)
+    {
+        static const char *words[] = {"position", "velocity", "inventory", "sword", "shield", "potion"};
+        std::string msg;
+        for (int k = 0; k < 24; k++)
+        {
+            msg += static_cast<char>((k % 6 + 1) << 3);
+            uint32_t v = (k % 3 == 0) ? static_cast<uint32_t>(i + k) : static_cast<uint32_t>(rand() % 300);
+            while (v >= 0x80)
+            {
+                msg += static_cast<char>(v | 0x80);
+                v >>= 7;
+            }
+            msg += static_cast<char>(v);
+            if (k % 4 == 0)
+            {
+                const char *w = words[rand() % 6];
+                msg += static_cast<char>(strlen(w));
+                msg += w;
+            }
+        }
+        return msg;
+    }
+
+    std::string random_message(int)
+    {
+        std::string msg(400, 0);
+        for (auto &c : msg)
+            c = static_cast<char>(rand());
+        return msg;
+    }
+
+    double cpu_seconds()
+    {
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
+
+    void bench_codec(const char *name, const std::vector<std::string> &msgs)
+    {
+        std::vector<char> packed(lz_compress_bound(64 * 1024));
+        std::vector<char> unpacked(64 * 1024);
+        size_t raw = 0, total = 0;
+
+        double t0 = cpu_seconds();
+        for (int round = 0; round < 10; round++)
+        {
+            for (auto &m : msgs)
+            {
+                int size = lz_compress(m.data(), static_cast<int>(m.size()), packed.data(), static_cast<int>(packed.size()));
+                raw += m.size();
+                total += size;
+            }
+        }
+        double t1 = cpu_seconds();
+
+        size_t out = 0;
+        std::vector<std::vector<char>> blocks;
+        for (auto &m : msgs)
+        {
+            int size = lz_compress(m.data(), static_cast<int>(m.size()), packed.data(), static_cast<int>(packed.size()));
+            blocks.emplace_back(packed.begin(), packed.begin() + size);
+        }
+        double t2 = cpu_seconds();
+        for (int round = 0; round < 10; round++)
+        {
+            for (auto &b : blocks)
+            {
+                out += lz_decompress(b.data(), static_cast<int>(b.size()), unpacked.data(), static_cast<int>(unpacked.size()));
+            }
+        }
+        double t3 = cpu_seconds();
+
+        double mb = raw / 1e6;
+        printf("codec data=%s ratio=%.3f compress_ms_per_mb=%.2f decompress_ms_per_mb=%.2f\n",
+               name, static_cast<double>(total) / raw, (t1 - t0) * 1e3 / mb, (t3 - t2) * 1e3 / (out / 1e6));
+    }
+
+    struct Wire
+    {
+        std::deque<std::string> packets;
+        size_t bytes = 0;
+    };
+
+    int wire_output(const char *buf, int len, Kcpp *, void *user)
+    {
+        Wire *wire = static_cast<Wire *>(user);
+        wire->packets.emplace_back(buf, len);
+        wire->bytes += len;
+        return 0;
+    }
+
+    void bench_session(const char *name, const std::vector<std::string> &msgs, bool compress)
+    {
+        Wire w12, w21;
+        Kcpp kcp1(0x11223344, &w12), kcp2(0x11223344, &w21);
+        kcp1.set_output(wire_output);
+        kcp2.set_output(wire_output);
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(1, 10, 2, true);
+        kcp1.set_wndsize(1024, 1024);
+        kcp2.set_wndsize(1024, 1024);
+        kcp1.set_compress(compress);
+        kcp2.set_compress(compress);
+
+        std::vector<char> buffer(64 * 1024);
+        size_t raw = 0, received = 0, errors = 0;
+        uint32_t current = 0;
+        size_t next = 0;
+
+        double t0 = cpu_seconds();
+        while (received < msgs.size() && current < 1000000)
+        {
+            current += 10;
+            for (int i = 0; i < 64 && next < msgs.size() && kcp1.wait_send_size() < 2048; i++, next++)
+            {
+                kcp1.send(msgs[next].data(), static_cast<int>(msgs[next].size()));
+                raw += msgs[next].size();
+            }
+            kcp1.update(current);
+            while (!w12.packets.empty())
+            {
+                kcp2.input(w12.packets.front().data(), static_cast<uint32_t>(w12.packets.front().size()));
+                w12.packets.pop_front();
+            }
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) >= 0)
+            {
+                const std::string &m = msgs[received++];
+                if (hr != static_cast<int>(m.size()) || memcmp(buffer.data(), m.data(), hr) != 0)
+                    errors++;
+            }
+            kcp2.update(current);
+            while (!w21.packets.empty())
+            {
+                kcp1.input(w21.packets.front().data(), static_cast<uint32_t>(w21.packets.front().size()));
+                w21.packets.pop_front();
+            }
+        }
+        double t1 = cpu_seconds();
+
+        double mb = raw / 1e6;
+        printf("session data=%s compress=%d wire_ratio=%.3f cpu_ms_per_mb=%.2f messages=%zu errors=%zu\n",
+               name, compress ? 1 : 0, static_cast<double>(w12.bytes) / raw, (t1 - t0) * 1e3 / mb, received, errors);
+    }
+}
+
+int main()
+{
+    srand(1);
+    struct
+    {
+        const char *name;
+        std::string (*make)(int);
+    } sets[] = {{"json", json_message}, {"proto", proto_message}, {"random", random_message}};
+
+    for (auto &set : sets)
+    {
+        std::vector<std::string> msgs;
+        for (int i = 0; i < MESSAGES; i++)
+        {
+            msgs.push_back(set.make(i));
+        }
+        bench_codec(set.name, msgs);
+        bench_session(set.name, msgs, false);
+        bench_session(set.name, msgs, true);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+//=====================================================================
+//
+// bench_crc.cpp - datagram checksum cost
+//
+// Measures crc32c in GB/s with the crc32 instruction and the tables,
+// then a bulk transfer between two Kcpp endpoints over loopback UDP,
+// with and without set_checksum(), to show the cost per session.
+//
+//=====================================================================
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <vector>
+
+#include "crc32c.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    double now_seconds()
+    {
+        using namespace std::chrono;
+        return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint32_t now_ms()
+    {
+        return static_cast<uint32_t>(static_cast<uint64_t>(now_seconds() * 1000));
+    }
+
+    double cpu_seconds()
+    {
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
+
+    void bench_crc(int size)
+    {
+        std::vector<char> data(size);
+        for (auto &c : data)
+            c = static_cast<char>(rand());
+
+        long rounds = (1L << 30) / size;
+        uint32_t crc = 0;
+        double t0 = now_seconds();
+        for (long i = 0; i < rounds; i++)
+        {
+            crc = crc32c(crc, data.data(), size);
+        }
+        double t1 = now_seconds();
+        printf("crc impl=%s size=%d gbps=%.2f ns_per_datagram=%.1f crc=%08x\n", crc32c_impl(), size,
+               static_cast<double>(rounds) * size / 1e9 / (t1 - t0), (t1 - t0) * 1e9 / rounds, crc);
+    }
+
+    int udp_socket(sockaddr_in &addr)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        addr.sin_family = AF_INET;
+        addr.sin_port = 0;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    int udp_output(const char *buf, int len, Kcpp *, void *user)
+    {
+        return static_cast<int>(send(*static_cast<int *>(user), buf, len, 0));
+    }
+
+    int drain(int fd, Kcpp &kcp, std::vector<char> &buffer)
+    {
+        int count = 0;
+        ssize_t n;
+        while ((n = recv(fd, buffer.data(), buffer.size(), 0)) > 0)
+        {
+            if (kcp.input(buffer.data(), static_cast<uint32_t>(n)) == -4)
+                count++;
+        }
+        return count;
+    }
+
+    // bulk transfer of 128MB, wall time and cpu time per MB
+    void bench_session(bool checksum)
+    {
+        sockaddr_in a1 = {}, a2 = {};
+        int fd1 = udp_socket(a1), fd2 = udp_socket(a2);
+        connect(fd1, reinterpret_cast<sockaddr *>(&a2), sizeof(a2));
+        connect(fd2, reinterpret_cast<sockaddr *>(&a1), sizeof(a1));
+
+        Kcpp kcp1(0x11223344, &fd1), kcp2(0x11223344, &fd2);
+        kcp1.set_output(udp_output);
+        kcp2.set_output(udp_output);
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(1, 10, 2, true);
+        kcp1.set_wndsize(128, 128);
+        kcp2.set_wndsize(128, 128);
+        kcp1.set_checksum(checksum);
+        kcp2.set_checksum(checksum);
+
+        const size_t total = 128u << 20;
+        std::vector<char> message(1200, 'x'), buffer(64 * 1024), packet(64 * 1024);
+        size_t sent = 0, received = 0;
+        int rejected = 0;
+
+        double w0 = now_seconds(), t0 = cpu_seconds();
+        while (received < total && now_seconds() - w0 < 60)
+        {
+            while (sent < total && kcp1.wait_send_size() < 256)
+            {
+                kcp1.send(message.data(), static_cast<int>(message.size()));
+                sent += message.size();
+            }
+            uint32_t current = now_ms();
+            kcp1.update(current);
+            kcp1.flush();
+            rejected += drain(fd2, kcp2, packet);
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) >= 0)
+            {
+                received += hr;
+            }
+            kcp2.update(current);
+            kcp2.flush();
+            rejected += drain(fd1, kcp1, packet);
+        }
+        double w1 = now_seconds(), t1 = cpu_seconds();
+        close(fd1);
+        close(fd2);
+
+        double mb = received / 1e6;
+        printf("session checksum=%d impl=%s mbps=%.1f cpu_ms_per_mb=%.3f rejected=%d\n", checksum ? 1 : 0,
+               crc32c_impl(), mb / (w1 - w0), (t1 - t0) * 1e3 / mb, rejected);
+    }
+}
+
+int main()
+{
+    srand(1);
+    const int sizes[] = {64, 512, 1400, 16384};
+    for (int hw = 1; hw >= 0; hw--)
+    {
+        crc32c_set_hw(hw != 0);
+        for (int size : sizes)
+        {
+            bench_crc(size);
+        }
+    }
+
+    crc32c_set_hw(true);
+    for (int round = 0; round < 2; round++)
+    {
+        bench_session(false);
+        bench_session(true);
+    }
+    return 0;
+}
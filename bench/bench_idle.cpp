@@ -0,0 +1,115 @@
+//=====================================================================
+//
+// bench_idle.cpp - memory of idle sessions
+//
+// Creates N sessions (1M by default), lets each exchange one message
+// with a short lived peer so its buffers are allocated, then measures
+// the heap per session before and after compact(), the latter after the
+// idle sessions went on being updated for a second. Heap is read from
+// glibc's mallinfo2(), elsewhere only sizeof is reported.
+//
+//=====================================================================
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    size_t heap_used()
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        return mallinfo2().uordblks;
+#else
+        return 0;
+#endif
+    }
+
+    // one message from session to peer, and the ack back
+    void exchange(Kcpp &session, uint32_t conv)
+    {
+        std::vector<std::string> to_peer, to_session;
+        Kcpp peer(conv, nullptr);
+        session.set_output([&to_peer](const char *buf, int len, Kcpp *, void *) {
+            to_peer.emplace_back(buf, len);
+            return len;
+        });
+        peer.set_output([&to_session](const char *buf, int len, Kcpp *, void *) {
+            to_session.emplace_back(buf, len);
+            return len;
+        });
+
+        char message[64] = {0};
+        session.update(0);
+        peer.update(0);
+        session.send(message, sizeof(message));
+        // the first flush only opens the congestion window
+        for (int round = 0; round < 4 && session.wait_send_size() > 0; round++)
+        {
+            session.flush();
+            for (auto &packet : to_peer)
+                peer.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to_peer.clear();
+            peer.recv(message, sizeof(message));
+            peer.flush();
+            for (auto &packet : to_session)
+                session.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to_session.clear();
+        }
+
+        // a server would keep its own output callback
+        session.set_output([](const char *, int len, Kcpp *, void *) { return len; });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    std::vector<std::unique_ptr<Kcpp>> sessions;
+    sessions.reserve(count);
+
+    size_t h0 = heap_used();
+    for (size_t i = 0; i < count; i++)
+    {
+        sessions.emplace_back(new Kcpp(static_cast<uint32_t>(i), nullptr));
+    }
+    size_t h1 = heap_used();
+    for (size_t i = 0; i < count; i++)
+    {
+        exchange(*sessions[i], static_cast<uint32_t>(i));
+    }
+    size_t h2 = heap_used();
+
+    size_t compacted = 0;
+    for (auto &session : sessions)
+    {
+        compacted += session->compact() ? 1 : 0;
+    }
+    // still ticked as a server would, with nothing to send
+    for (uint32_t current = 100; current <= 1000; current += 100)
+    {
+        for (auto &session : sessions)
+        {
+            session->update(current);
+        }
+    }
+    size_t h3 = heap_used();
+
+    printf("idle sessions=%zu sizeof=%zu compacted=%zu\n", count, sizeof(Kcpp), compacted);
+    printf("idle state=new bytes_per_session=%.0f\n", static_cast<double>(h1 - h0) / count);
+    printf("idle state=used bytes_per_session=%.0f total_mb=%.1f\n", static_cast<double>(h2 - h0) / count,
+           (h2 - h0) / 1e6);
+    printf("idle state=compact bytes_per_session=%.0f total_mb=%.1f\n", static_cast<double>(h3 - h0) / count,
+           (h3 - h0) / 1e6);
+    return 0;
+}
@@ -0,0 +1,300 @@
+//=====================================================================
+//
+// bench_ikcp.cpp - kcpp against the C original
+//
+// Runs the same workloads through Kcpp and through skywind3000's ikcp,
+// which is not part of the tree: put ikcp.c and ikcp.h from
+// https://github.com/skywind3000/kcp in third_party/ikcp/ and the
+// bench_ikcp target appears. Both get identical settings:
+//
+//   bulk     in memory, no loss, 64MB of 4KB messages: MB/s and cpu
+//            seconds per GB, as in bench_suite
+//   latency  the test.cpp echo over NetSim with the same seed: avg and
+//            max rtt, datagrams sent
+//   wire     a scripted session with varied message sizes and a fixed
+//            drop pattern, every datagram of both sides compared byte
+//            for byte. Kcpp extensions are off unless negotiated, so a
+//            difference is a compatibility bug.
+//
+// One key=value line per result, impl=kcpp or impl=ikcp.
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ikcp.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    // ikcp behind the member functions the workloads call on Kcpp
+    class Ikcp
+    {
+    public:
+        using outputCallBack = std::function<int(const char *buf, int len, Ikcp *kcp, void *user)>;
+
+        Ikcp(uint32_t conv, void *user) : kcp_(ikcp_create(conv, this)), user_(user)
+        {
+            ikcp_setoutput(kcp_, &Ikcp::output);
+        }
+        ~Ikcp()
+        {
+            ikcp_release(kcp_);
+        }
+        Ikcp(const Ikcp &) = delete;
+        Ikcp &operator=(const Ikcp &) = delete;
+
+        int send(const char *data, int len) { return ikcp_send(kcp_, data, len); }
+        int recv(char *buffer, int len) { return ikcp_recv(kcp_, buffer, len); }
+        int input(const char *data, uint32_t size) { return ikcp_input(kcp_, data, static_cast<long>(size)); }
+        // Kcpp's first update() schedules the first flush an interval on,
+        // ikcp's flushes at once: ikcp is held back until then, so the two
+        // flush at the same times
+        void update(uint32_t current)
+        {
+            if (!started_)
+            {
+                started_ = true;
+                start_ = current + kcp_->interval;
+            }
+            if (static_cast<int32_t>(current - start_) >= 0)
+                ikcp_update(kcp_, current);
+        }
+        int32_t check(uint32_t current)
+        {
+            if (started_ && static_cast<int32_t>(current - start_) < 0)
+                return static_cast<int32_t>(start_);
+            return static_cast<int32_t>(ikcp_check(kcp_, current));
+        }
+        void flush() { ikcp_flush(kcp_); }
+        int wait_send_size() { return ikcp_waitsnd(kcp_); }
+        void no_delay(int nodelay, int interval, int resend, bool nocwnd)
+        {
+            ikcp_nodelay(kcp_, nodelay, interval, resend, nocwnd ? 1 : 0);
+        }
+        void set_wndsize(int sndwnd, int rcvwnd) { ikcp_wndsize(kcp_, sndwnd, rcvwnd); }
+        bool set_mtu(int mtu) { return ikcp_setmtu(kcp_, mtu) == 0; }
+        void set_minrto(int minrto) { kcp_->rx_minrto = minrto; }
+        void set_fastresend(int fastresend) { kcp_->fastresend = fastresend; }
+        void set_output(const outputCallBack &func) { output_ = func; }
+
+    private:
+        static int output(const char *buf, int len, ikcpcb *, void *user)
+        {
+            Ikcp *self = static_cast<Ikcp *>(user);
+            return self->output_ ? self->output_(buf, len, self, self->user_) : len;
+        }
+
+    private:
+        ikcpcb *kcp_;
+        void *user_;
+        outputCallBack output_;
+        bool started_ = false;
+        uint32_t start_ = 0;
+    };
+
+    template <typename K>
+    void bulk(const char *impl)
+    {
+        const size_t total = 64u << 20;
+        const int size = 4096;
+        const uint32_t wnd = 256;
+        std::vector<std::string> to1, to2;
+        K kcp1(1, nullptr), kcp2(1, nullptr);
+        kcp1.set_output([&to2](const char *buf, int len, K *, void *) {
+            to2.emplace_back(buf, len);
+            return len;
+        });
+        kcp2.set_output([&to1](const char *buf, int len, K *, void *) {
+            to1.emplace_back(buf, len);
+            return len;
+        });
+        for (K *kcp : {&kcp1, &kcp2})
+        {
+            kcp->no_delay(1, 10, 2, true);
+            kcp->set_wndsize(wnd, wnd);
+        }
+
+        std::vector<char> message(size, 'x'), buffer(size);
+        size_t sent = 0, received = 0;
+        uint32_t current = 0;
+        std::clock_t c0 = std::clock();
+        auto t0 = std::chrono::steady_clock::now();
+        while (received < total)
+        {
+            while (sent < total && kcp1.wait_send_size() < static_cast<int>(wnd * 2))
+            {
+                kcp1.send(message.data(), size);
+                sent += size;
+            }
+            current += 10;
+            kcp1.update(current);
+            for (auto &packet : to2)
+                kcp2.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to2.clear();
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), size)) > 0)
+                received += hr;
+            kcp2.update(current);
+            for (auto &packet : to1)
+                kcp1.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to1.clear();
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double cpu = static_cast<double>(std::clock() - c0) / CLOCKS_PER_SEC;
+        printf("compare=bulk impl=%s mbps=%.1f cpu_s_per_gb=%.3f\n", impl, received / 1e6 / wall,
+               cpu / (received / 1e9));
+    }
+
+    template <typename K>
+    void latency(const char *impl, int mode)
+    {
+        K kcp1(0x11223344, nullptr), kcp2(0x11223344, nullptr);
+        for (K *kcp : {&kcp1, &kcp2})
+        {
+            kcp->set_wndsize(128, 128);
+            if (mode == 0)
+                kcp->no_delay(0, 10, 0, false);
+            else if (mode == 1)
+                kcp->no_delay(0, 10, 0, true);
+            else
+                kcp->no_delay(2, 10, 2, true);
+        }
+        if (mode == 2)
+        {
+            kcp1.set_minrto(10);
+            kcp1.set_fastresend(1);
+        }
+
+        NetSimLink link;
+        link.delay_min = 30;
+        link.delay_max = 62;
+        link.loss_good = 0.05;
+        NetSim sim(1);
+        sim.attach(kcp1, kcp2, link, link);
+
+        uint32_t index = 0, count = 0, maxrtt = 0;
+        int64_t sumrtt = 0;
+        std::function<void()> tick = [&] {
+            char buffer[8];
+            uint32_t now = sim.now();
+            memcpy(buffer, &index, 4);
+            memcpy(buffer + 4, &now, 4);
+            index++;
+            kcp1.send(buffer, 8);
+            sim.at(now + 20, tick);
+        };
+        sim.at(0, tick);
+        sim.set_poll([&] {
+            char buffer[2000];
+            int hr;
+            while ((hr = kcp2.recv(buffer, 10)) > 0)
+                kcp2.send(buffer, hr);
+            while ((hr = kcp1.recv(buffer, 10)) > 0)
+            {
+                uint32_t ts;
+                memcpy(&ts, buffer + 4, 4);
+                uint32_t rtt = sim.now() - ts;
+                sumrtt += rtt;
+                maxrtt = rtt > maxrtt ? rtt : maxrtt;
+                if (++count > 1000)
+                    sim.stop();
+            }
+        });
+        sim.run(3600 * 1000);
+        printf("compare=latency impl=%s mode=%d avgrtt=%d maxrtt=%u tx=%llu\n", impl, mode,
+               count > 0 ? static_cast<int>(sumrtt / count) : -1, maxrtt,
+               static_cast<unsigned long long>(sim.stats(0).sent));
+    }
+
+    // every datagram of a scripted session, prefixed by its direction
+    template <typename K>
+    std::vector<std::string> wire()
+    {
+        std::vector<std::string> datagrams, to1, to2;
+        K kcp1(0x11223344, nullptr), kcp2(0x11223344, nullptr);
+        kcp1.set_output([&](const char *buf, int len, K *, void *) {
+            datagrams.push_back('>' + std::string(buf, len));
+            to2.emplace_back(buf, len);
+            return len;
+        });
+        kcp2.set_output([&](const char *buf, int len, K *, void *) {
+            datagrams.push_back('<' + std::string(buf, len));
+            to1.emplace_back(buf, len);
+            return len;
+        });
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(0, 10, 0, false);
+
+        std::vector<char> buffer(64 * 1024);
+        uint32_t drop = 0;
+        auto deliver = [&drop](std::vector<std::string> &packets, K &kcp) {
+            for (auto &packet : packets)
+                if (++drop % 7 != 0)
+                    kcp.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            packets.clear();
+        };
+        for (uint32_t current = 0; current < 5000; current += 5)
+        {
+            if (current < 3000 && current % 20 == 0)
+            {
+                int len = 1 + static_cast<int>((current * 2654435761u) % 5000);
+                memset(buffer.data(), static_cast<int>(current), len);
+                kcp1.send(buffer.data(), len);
+                if (current % 100 == 0)
+                    kcp2.send(buffer.data(), len / 4 + 1);
+            }
+            kcp1.update(current);
+            kcp2.update(current);
+            deliver(to2, kcp2);
+            deliver(to1, kcp1);
+            while (kcp1.recv(buffer.data(), static_cast<int>(buffer.size())) > 0)
+                ;
+            while (kcp2.recv(buffer.data(), static_cast<int>(buffer.size())) > 0)
+                ;
+        }
+        return datagrams;
+    }
+
+    void compare_wire()
+    {
+        std::vector<std::string> a = wire<Kcpp>(), b = wire<Ikcp>();
+        size_t count = a.size() < b.size() ? a.size() : b.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            if (a[i] != b[i])
+            {
+                size_t at = 0;
+                while (at < a[i].size() && at < b[i].size() && a[i][at] == b[i][at])
+                    at++;
+                // the byte offset excludes the direction prefix
+                printf("compare=wire datagrams=%zu/%zu match=0 first_diff=%zu dir=%c offset=%zu size=%zu/%zu\n",
+                       a.size(), b.size(), i, a[i][0], at > 0 ? at - 1 : 0, a[i].size() - 1, b[i].size() - 1);
+                return;
+            }
+        }
+        printf("compare=wire datagrams=%zu/%zu match=%d\n", a.size(), b.size(), a.size() == b.size() ? 1 : 0);
+    }
+}
+
+int main()
+{
+    bulk<Kcpp>("kcpp");
+    bulk<Ikcp>("ikcp");
+    for (int mode = 0; mode < 3; mode++)
+    {
+        latency<Kcpp>("kcpp", mode);
+        latency<Ikcp>("ikcp", mode);
+    }
+    compare_wire();
+    return 0;
+}
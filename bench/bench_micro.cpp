@@ -0,0 +1,273 @@
+//=====================================================================
+//
+// bench_micro.cpp - cost of the individual Kcpp operations
+//
+// Each case times one operation with everything else done untimed,
+// for send and receive windows of 32, 256 and 2048 segments:
+//
+//   send_message    send() of 8KB in message mode, fragmented
+//   send_stream     send() of 8KB in stream mode
+//   input_mixed     input() of a datagram with ACKs followed by PUSHes
+//   flush_inflight  flush() with a full window in flight, nothing due
+//   recv_16frag     recv() of a message reassembled from 16 fragments
+//   check           check() with a full window in flight
+//
+// Reports ns/op, and heap allocations and bytes allocated per op,
+// counted by a global operator new. One key=value line per case.
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    uint64_t allocations = 0, allocated = 0;
+}
+
+void *operator new(size_t size)
+{
+    allocations++;
+    allocated += size;
+    if (void *p = malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+// not inlined, else gcc takes the free() for a mismatch with new
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+BENCH_NOINLINE void operator delete(void *p) noexcept
+{
+    free(p);
+}
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    const uint32_t windows[] = {32, 256, 2048};
+
+    // timed sections of many batches, until enough time has been spent
+    class Meter
+    {
+    public:
+        void start()
+        {
+            allocs0_ = allocations;
+            bytes0_ = allocated;
+            t0_ = std::chrono::steady_clock::now();
+        }
+        void stop(uint64_t ops)
+        {
+            seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+            allocs_ += allocations - allocs0_;
+            bytes_ += allocated - bytes0_;
+            ops_ += ops;
+        }
+        bool done() const
+        {
+            return seconds_ >= 0.2;
+        }
+        void print(const char *name, uint32_t wnd) const
+        {
+            printf("micro case=%s wnd=%u ops=%llu ns_per_op=%.1f allocs_per_op=%.2f bytes_per_op=%.0f\n", name, wnd,
+                   static_cast<unsigned long long>(ops_), seconds_ * 1e9 / ops_,
+                   static_cast<double>(allocs_) / ops_, static_cast<double>(bytes_) / ops_);
+        }
+
+    private:
+        std::chrono::steady_clock::time_point t0_;
+        uint64_t allocs0_ = 0, bytes0_ = 0;
+        double seconds_ = 0;
+        uint64_t allocs_ = 0, bytes_ = 0, ops_ = 0;
+    };
+
+    // two sessions that know each other's window, with their datagrams
+    // collected instead of delivered
+    struct Pair
+    {
+        std::unique_ptr<Kcpp> a, b;
+        std::vector<std::string> to_a, to_b;
+
+        explicit Pair(uint32_t wnd) : a(new Kcpp(1, nullptr)), b(new Kcpp(1, nullptr))
+        {
+            a->set_output([this](const char *buf, int len, Kcpp *, void *) {
+                to_b.emplace_back(buf, len);
+                return len;
+            });
+            b->set_output([this](const char *buf, int len, Kcpp *, void *) {
+                to_a.emplace_back(buf, len);
+                return len;
+            });
+            for (Kcpp *kcp : {a.get(), b.get()})
+            {
+                kcp->no_delay(1, 10, 2, true);
+                kcp->set_wndsize(wnd, wnd);
+                kcp->update(0);
+            }
+
+            // one message each way, so rmt_wnd is known
+            char byte = 0;
+            a->send(&byte, 1);
+            b->send(&byte, 1);
+            for (int round = 0; round < 2; round++)
+            {
+                a->flush();
+                b->flush();
+                deliver_to_b();
+                deliver_to_a();
+                a->recv(&byte, 1);
+                b->recv(&byte, 1);
+            }
+        }
+
+        void deliver_to_a()
+        {
+            for (auto &packet : to_a)
+                a->input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to_a.clear();
+        }
+        void deliver_to_b()
+        {
+            for (auto &packet : to_b)
+                b->input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to_b.clear();
+        }
+    };
+
+    void send_case(const char *name, bool stream, uint32_t wnd)
+    {
+        std::vector<char> message(8192, 'x');
+        Meter meter;
+        while (!meter.done())
+        {
+            Kcpp kcp(1, nullptr);
+            kcp.set_wndsize(wnd, wnd);
+            kcp.set_stream(stream);
+            meter.start();
+            for (uint32_t i = 0; i < wnd; i++)
+                kcp.send(message.data(), static_cast<int>(message.size()));
+            meter.stop(wnd);
+        }
+        meter.print(name, wnd);
+    }
+
+    void input_mixed(uint32_t wnd)
+    {
+        std::vector<char> message(1000, 'x');
+        Meter meter;
+        while (!meter.done())
+        {
+            Pair pair(wnd);
+            for (uint32_t i = 0; i < wnd; i++)
+                pair.a->send(message.data(), static_cast<int>(message.size()));
+            pair.a->flush();
+            pair.deliver_to_b();
+            // b acks a's data and sends its own in the same datagrams
+            for (uint32_t i = 0; i < wnd; i++)
+                pair.b->send(message.data(), static_cast<int>(message.size()));
+            pair.b->flush();
+
+            std::vector<std::string> datagrams;
+            datagrams.swap(pair.to_a);
+            meter.start();
+            for (auto &packet : datagrams)
+                pair.a->input(packet.data(), static_cast<uint32_t>(packet.size()));
+            meter.stop(datagrams.size());
+        }
+        meter.print("input_mixed", wnd);
+    }
+
+    // a full window sent by a, none of it acked or due for resend
+    void fill_window(Pair &pair, uint32_t wnd)
+    {
+        std::vector<char> message(1000, 'x');
+        for (uint32_t i = 0; i < wnd; i++)
+            pair.a->send(message.data(), static_cast<int>(message.size()));
+        pair.a->flush();
+        pair.to_b.clear();
+    }
+
+    void flush_inflight(uint32_t wnd)
+    {
+        Meter meter;
+        while (!meter.done())
+        {
+            Pair pair(wnd);
+            fill_window(pair, wnd);
+            meter.start();
+            for (int i = 0; i < 1000; i++)
+                pair.a->flush();
+            meter.stop(1000);
+        }
+        meter.print("flush_inflight", wnd);
+    }
+
+    void check(uint32_t wnd)
+    {
+        Meter meter;
+        int32_t sum = 0;
+        while (!meter.done())
+        {
+            Pair pair(wnd);
+            fill_window(pair, wnd);
+            meter.start();
+            for (uint32_t i = 0; i < 10000; i++)
+                sum += pair.a->check(i % 5);
+            meter.stop(10000);
+        }
+        if (sum == 42)
+            printf("\n"); // keep the calls
+        meter.print("check", wnd);
+    }
+
+    void recv_fragments(uint32_t wnd)
+    {
+        const uint32_t fragments = 16;
+        const int size = 1376 * fragments; // mss of the default mtu
+        std::vector<char> message(size, 'x'), buffer(size);
+        Meter meter;
+        while (!meter.done())
+        {
+            Pair pair(wnd);
+            uint32_t count = wnd / fragments;
+            for (uint32_t i = 0; i < count; i++)
+                pair.a->send(message.data(), size);
+            pair.a->flush();
+            pair.deliver_to_b();
+            meter.start();
+            for (uint32_t i = 0; i < count; i++)
+                pair.b->recv(buffer.data(), size);
+            meter.stop(count);
+        }
+        meter.print("recv_16frag", wnd);
+    }
+}
+
+int main()
+{
+    for (uint32_t wnd : windows)
+    {
+        send_case("send_message", false, wnd);
+        send_case("send_stream", true, wnd);
+        input_mixed(wnd);
+        flush_inflight(wnd);
+        recv_fragments(wnd);
+        check(wnd);
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+//=====================================================================
+//
+// bench_profile.cpp - where flush() and input() spend their time
+//
+// Built with KCP_PROFILE. Two Kcpp endpoints joined in memory move
+// 256MB with 1% loss at several window sizes, then the sender's and the
+// receiver's phase profiles are printed, one line per phase with its
+// log2 histogram of ticks per call (cycles on x86, ns elsewhere).
+//
+//=====================================================================
+
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    void print_profile(const char *side, uint32_t wnd, const KcpProfile &profile)
+    {
+        for (int p = 0; p < KCP_PHASE_COUNT; p++)
+        {
+            const KcpPhaseProfile &phase = profile.phases[p];
+            if (phase.calls == 0)
+                continue;
+            printf("profile side=%s wnd=%u phase=%s calls=%llu ticks_per_call=%.0f hist=", side, wnd,
+                   kcp_phase_name(p), static_cast<unsigned long long>(phase.calls),
+                   static_cast<double>(phase.ticks) / phase.calls);
+            // trailing empty buckets left out
+            uint32_t last = 0;
+            for (uint32_t b = 0; b < KCP_PROFILE_BUCKETS; b++)
+                if (phase.buckets[b] > 0)
+                    last = b;
+            for (uint32_t b = 0; b <= last; b++)
+                printf("%s%llu", b > 0 ? "," : "", static_cast<unsigned long long>(phase.buckets[b]));
+            printf("\n");
+        }
+    }
+
+    void bench(uint32_t wnd)
+    {
+        std::deque<std::string> to1, to2;
+        std::mt19937 rng(1);
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        kcp1.set_output([&](const char *buf, int len, Kcpp *, void *) {
+            if (rng() % 100 != 0)
+                to2.emplace_back(buf, len);
+            return len;
+        });
+        kcp2.set_output([&](const char *buf, int len, Kcpp *, void *) {
+            if (rng() % 100 != 0)
+                to1.emplace_back(buf, len);
+            return len;
+        });
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(1, 10, 2, true);
+        kcp1.set_wndsize(wnd, wnd);
+        kcp2.set_wndsize(wnd, wnd);
+
+        const size_t total = 256u << 20;
+        const int size = 64 * 1024;
+        std::vector<char> message(size, 'x');
+        size_t sent = 0, received = 0;
+        uint32_t current = 0;
+        while (received < total)
+        {
+            while (sent < total && kcp1.wait_send_size() < static_cast<int>(wnd * 2))
+            {
+                kcp1.send(message.data(), size);
+                sent += size;
+            }
+            current += 10;
+            kcp1.update(current);
+            for (auto &packet : to2)
+                kcp2.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to2.clear();
+            int hr;
+            while ((hr = kcp2.recv(message.data(), size)) > 0)
+                received += hr;
+            kcp2.update(current);
+            for (auto &packet : to1)
+                kcp1.input(packet.data(), static_cast<uint32_t>(packet.size()));
+            to1.clear();
+        }
+        print_profile("send", wnd, kcp1.profile());
+        print_profile("recv", wnd, kcp2.profile());
+    }
+}
+
+int main()
+{
+#if !KCP_PROFILE
+    fprintf(stderr, "built without KCP_PROFILE, nothing to report\n");
+    return 1;
+#endif
+    const uint32_t windows[] = {128, 1024, 8192};
+    for (uint32_t wnd : windows)
+    {
+        bench(wnd);
+    }
+    return 0;
+}
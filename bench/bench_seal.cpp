@@ -0,0 +1,170 @@
+//=====================================================================
+//
+// bench_seal.cpp - datagram sealing throughput
+//
+// Measures ChaCha20-Poly1305 seal/open in GB/s for datagram sized
+// buffers with the vectorized and the scalar kernels, then the cpu
+// cost of a pair of Kcpp endpoints with and without set_cipher().
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "aead.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    double now_seconds()
+    {
+        using namespace std::chrono;
+        return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    double cpu_seconds()
+    {
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+    }
+
+    void bench_aead(int size)
+    {
+        uint8_t key[AEAD_KEY_LEN], nonce[AEAD_NONCE_LEN] = {0}, tag[AEAD_TAG_LEN];
+        for (auto &b : key)
+            b = static_cast<uint8_t>(rand());
+        std::vector<char> data(size), out(size);
+        for (auto &c : data)
+            c = static_cast<char>(rand());
+        char ad[8] = {0};
+
+        const long total = 1L << 28;
+        long rounds = total / size;
+
+        double t0 = now_seconds();
+        for (long i = 0; i < rounds; i++)
+        {
+            memcpy(ad, &i, sizeof(ad));
+            aead_seal(key, nonce, ad, sizeof(ad), data.data(), size, tag);
+        }
+        double t1 = now_seconds();
+
+        memset(ad, 0, sizeof(ad));
+        aead_seal(key, nonce, ad, sizeof(ad), data.data(), size, tag);
+        double t2 = now_seconds();
+        long opened = 0;
+        for (long i = 0; i < rounds; i++)
+        {
+            opened += aead_open(key, nonce, ad, sizeof(ad), data.data(), size, tag, out.data());
+        }
+        double t3 = now_seconds();
+
+        double gb = static_cast<double>(rounds) * size / 1e9;
+        printf("aead impl=%s size=%d seal_gbps=%.2f open_gbps=%.2f opened=%ld\n",
+               aead_impl(), size, gb / (t1 - t0), gb / (t3 - t2), opened);
+    }
+
+    struct Wire
+    {
+        std::deque<std::string> packets;
+        size_t bytes = 0;
+    };
+
+    int wire_output(const char *buf, int len, Kcpp *, void *user)
+    {
+        Wire *wire = static_cast<Wire *>(user);
+        wire->packets.emplace_back(buf, len);
+        wire->bytes += len;
+        return 0;
+    }
+
+    // bulk transfer of 256MB over a lossless link, cpu time per MB
+    void bench_session(bool sealed)
+    {
+        Wire w12, w21;
+        Kcpp kcp1(0x11223344, &w12), kcp2(0x11223344, &w21);
+        kcp1.set_output(wire_output);
+        kcp2.set_output(wire_output);
+        kcp1.no_delay(1, 10, 2, true);
+        kcp2.no_delay(1, 10, 2, true);
+        kcp1.set_wndsize(1024, 1024);
+        kcp2.set_wndsize(1024, 1024);
+        if (sealed)
+        {
+            uint8_t k1[AEAD_KEY_LEN], k2[AEAD_KEY_LEN];
+            for (int i = 0; i < AEAD_KEY_LEN; i++)
+            {
+                k1[i] = static_cast<uint8_t>(rand());
+                k2[i] = static_cast<uint8_t>(rand());
+            }
+            kcp1.set_cipher(k1, k2);
+            kcp2.set_cipher(k2, k1);
+        }
+
+        const size_t total = 256u << 20;
+        std::vector<char> message(1200, 'x'), buffer(64 * 1024);
+        size_t sent = 0, received = 0;
+        uint32_t current = 0;
+
+        double t0 = cpu_seconds();
+        while (received < total && current < 10000000)
+        {
+            current += 10;
+            while (sent < total && kcp1.wait_send_size() < 2048)
+            {
+                kcp1.send(message.data(), static_cast<int>(message.size()));
+                sent += message.size();
+            }
+            kcp1.update(current);
+            while (!w12.packets.empty())
+            {
+                kcp2.input(w12.packets.front().data(), static_cast<uint32_t>(w12.packets.front().size()));
+                w12.packets.pop_front();
+            }
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) >= 0)
+            {
+                received += hr;
+            }
+            kcp2.update(current);
+            while (!w21.packets.empty())
+            {
+                kcp1.input(w21.packets.front().data(), static_cast<uint32_t>(w21.packets.front().size()));
+                w21.packets.pop_front();
+            }
+        }
+        double t1 = cpu_seconds();
+
+        double mb = received / 1e6;
+        printf("session sealed=%d impl=%s received_mb=%.0f cpu_ms_per_mb=%.3f wire_overhead=%.3f\n",
+               sealed ? 1 : 0, aead_impl(), mb, (t1 - t0) * 1e3 / mb, static_cast<double>(w12.bytes) / received);
+    }
+}
+
+int main()
+{
+    srand(1);
+    const int sizes[] = {64, 512, 1400, 16384};
+    for (int simd = 1; simd >= 0; simd--)
+    {
+        aead_set_simd(simd != 0);
+        for (int size : sizes)
+        {
+            bench_aead(size);
+        }
+    }
+
+    aead_set_simd(true);
+    bench_session(false);
+    bench_session(true);
+    aead_set_simd(false);
+    bench_session(true);
+    return 0;
+}
@@ -0,0 +1,192 @@
+//=====================================================================
+//
+// bench_shm.cpp - same host round trip latency, shared memory vs UDP
+//
+// Forks an echo peer and measures the round trip of a 64 byte message
+// between two Kcpp endpoints, over ShmTransport and over loopback UDP.
+// Each side flushes right after send() and input(), so the numbers are
+// the transport plus the protocol, not the update() interval.
+//
+//=====================================================================
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+#include "shm_transport.h"
+
+using namespace stone;
+
+namespace
+{
+    int64_t now_us()
+    {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct ShmLink
+    {
+        ShmTransport shm;
+
+        int send(const char *data, int len) { return shm.send(data, len); }
+        bool wait(int64_t timeout_us) { return shm.wait(timeout_us); }
+        int drain(Kcpp &kcp) { return shm.drain(kcp); }
+    };
+
+    struct UdpLink
+    {
+        int fd = -1;
+        char buffer[64 * 1024];
+
+        int send(const char *data, int len) { return static_cast<int>(::send(fd, data, len, 0)); }
+
+        bool wait(int64_t timeout_us)
+        {
+            pollfd pfd = {fd, POLLIN, 0};
+            timespec ts = {static_cast<time_t>(timeout_us / 1000000), static_cast<long>(timeout_us % 1000000) * 1000};
+            return ppoll(&pfd, 1, &ts, nullptr) > 0;
+        }
+
+        int drain(Kcpp &kcp)
+        {
+            int count = 0;
+            ssize_t n;
+            while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0)
+            {
+                kcp.input(buffer, static_cast<uint32_t>(n));
+                count++;
+            }
+            return count;
+        }
+    };
+
+    int udp_socket(sockaddr_in &addr)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        addr.sin_family = AF_INET;
+        addr.sin_port = 0;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &len);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        return fd;
+    }
+
+    template <typename Link>
+    void setup(Kcpp &kcp, Link &link)
+    {
+        kcp.set_output([&link](const char *buf, int len, Kcpp *, void *) { return link.send(buf, len); });
+        kcp.no_delay(1, 10, 2, true);
+        kcp.update(static_cast<uint32_t>(now_us() / 1000));
+    }
+
+    // the peer: send every message back, until killed
+    template <typename Link>
+    void echo(Link &link)
+    {
+        Kcpp kcp(0x11223344, nullptr);
+        setup(kcp, link);
+        char message[2048];
+        while (true)
+        {
+            link.wait(10000);
+            link.drain(kcp);
+            int len;
+            while ((len = kcp.recv(message, sizeof(message))) > 0)
+            {
+                kcp.send(message, len);
+            }
+            kcp.update(static_cast<uint32_t>(now_us() / 1000));
+            kcp.flush();
+        }
+    }
+
+    template <typename Link>
+    void ping(Link &link, const char *transport, int rounds)
+    {
+        Kcpp kcp(0x11223344, nullptr);
+        setup(kcp, link);
+        char message[64] = {0}, reply[2048];
+        std::vector<int64_t> rtts;
+
+        int warmup = rounds / 10;
+        for (int i = 0; i < warmup + rounds; i++)
+        {
+            int64_t t0 = now_us();
+            kcp.send(message, sizeof(message));
+            kcp.flush();
+            while (kcp.recv(reply, sizeof(reply)) < 0)
+            {
+                link.wait(10000);
+                link.drain(kcp);
+                kcp.update(static_cast<uint32_t>(now_us() / 1000));
+            }
+            if (i >= warmup)
+                rtts.push_back(now_us() - t0);
+            kcp.flush(); // ack the reply
+        }
+
+        std::sort(rtts.begin(), rtts.end());
+        printf("rtt transport=%s rounds=%d p50_us=%lld p99_us=%lld max_us=%lld\n", transport, rounds,
+               static_cast<long long>(rtts[rtts.size() / 2]), static_cast<long long>(rtts[rtts.size() * 99 / 100]),
+               static_cast<long long>(rtts.back()));
+    }
+
+    template <typename Link>
+    void run(Link &client, Link &server, const char *transport, int rounds)
+    {
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            echo(server);
+            _exit(0);
+        }
+        ping(client, transport, rounds);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+
+    std::string name = "/bench_shm." + std::to_string(getpid());
+    ShmLink *client = new ShmLink, *server = new ShmLink;
+    if (!client->shm.create(name, 1 << 20) || !server->shm.attach(name))
+    {
+        printf("shared memory unavailable\n");
+        return 1;
+    }
+    run(*client, *server, "shm", rounds);
+    delete server;
+    delete client;
+
+    sockaddr_in a1 = {}, a2 = {};
+    UdpLink *udp1 = new UdpLink, *udp2 = new UdpLink;
+    udp1->fd = udp_socket(a1);
+    udp2->fd = udp_socket(a2);
+    connect(udp1->fd, reinterpret_cast<sockaddr *>(&a2), sizeof(a2));
+    connect(udp2->fd, reinterpret_cast<sockaddr *>(&a1), sizeof(a1));
+    run(*udp1, *udp2, "udp", rounds);
+    close(udp1->fd);
+    close(udp2->fd);
+    delete udp2;
+    delete udp1;
+    return 0;
+}
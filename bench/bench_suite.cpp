@@ -0,0 +1,214 @@
+//=====================================================================
+//
+// bench_suite.cpp - throughput and latency across configurations
+//
+// For each no_delay preset (default, normal, fast), mtu and window size:
+//
+//   bulk     two endpoints joined in memory, no loss, move 64MB of 4KB
+//            messages as fast as the cpu allows. Reports MB/s of wall
+//            time, cpu seconds per GB and heap allocations per message.
+//            The pipe reuses its buffers, every allocation is the
+//            protocol's.
+//   latency  200 byte messages every 10ms for 60 simulated seconds over
+//            NetSim, 20-40ms one way, 2% loss each way. Reports one way
+//            message latency percentiles in ms.
+//
+// One line per case, key=value, for scripts. Non-interactive; an
+// argument scales the bulk size in MB.
+//
+//=====================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    uint64_t allocations = 0;
+}
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p = malloc(size > 0 ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    struct Preset
+    {
+        const char *name;
+        int nodelay, interval, resend;
+        bool nocwnd;
+    };
+    const Preset presets[] = {
+        {"default", 0, 10, 0, false},
+        {"normal", 0, 10, 0, true},
+        {"fast", 2, 10, 2, true},
+    };
+    const int mtus[] = {576, 1400, 8192};
+    const uint32_t windows[] = {32, 128, 1024};
+
+    void setup(Kcpp &kcp, const Preset &preset, int mtu, uint32_t wnd)
+    {
+        kcp.no_delay(preset.nodelay, preset.interval, preset.resend, preset.nocwnd);
+        kcp.set_mtu(mtu);
+        kcp.set_wndsize(wnd, wnd);
+    }
+
+    // datagrams in flight between two endpoints, without allocating once warm
+    struct Pipe
+    {
+        std::vector<std::string> packets;
+        size_t count = 0;
+
+        void push(const char *buf, int len)
+        {
+            if (count == packets.size())
+                packets.emplace_back();
+            packets[count++].assign(buf, len);
+        }
+        void drain(Kcpp &kcp)
+        {
+            for (size_t i = 0; i < count; i++)
+                kcp.input(packets[i].data(), static_cast<uint32_t>(packets[i].size()));
+            count = 0;
+        }
+    };
+
+    void bulk(const Preset &preset, int mtu, uint32_t wnd, size_t total)
+    {
+        const int size = 4096;
+        Pipe to1, to2;
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        kcp1.set_output([&to2](const char *buf, int len, Kcpp *, void *) {
+            to2.push(buf, len);
+            return len;
+        });
+        kcp2.set_output([&to1](const char *buf, int len, Kcpp *, void *) {
+            to1.push(buf, len);
+            return len;
+        });
+        setup(kcp1, preset, mtu, wnd);
+        setup(kcp2, preset, mtu, wnd);
+
+        std::vector<char> message(size, 'x'), buffer(size);
+        size_t sent = 0, received = 0, messages = 0;
+        uint32_t current = 0;
+        uint64_t a0 = allocations;
+        std::clock_t c0 = std::clock();
+        auto t0 = std::chrono::steady_clock::now();
+        while (received < total)
+        {
+            while (sent < total && kcp1.wait_send_size() < static_cast<int>(wnd * 2))
+            {
+                kcp1.send(message.data(), size);
+                sent += size;
+                messages++;
+            }
+            // every round is one interval, so every update flushes
+            current += preset.interval;
+            kcp1.update(current);
+            to2.drain(kcp2);
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), size)) > 0)
+                received += hr;
+            kcp2.update(current);
+            to1.drain(kcp1);
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        double cpu = static_cast<double>(std::clock() - c0) / CLOCKS_PER_SEC;
+        uint64_t allocs = allocations - a0;
+
+        printf("bench=bulk preset=%s mtu=%d wnd=%u msg=%d mb=%.0f mbps=%.1f cpu_s_per_gb=%.3f "
+               "allocs_per_msg=%.2f\n",
+               preset.name, mtu, wnd, size, received / 1e6, received / 1e6 / wall, cpu / (received / 1e9),
+               static_cast<double>(allocs) / messages);
+    }
+
+    void latency(const Preset &preset, int mtu, uint32_t wnd)
+    {
+        const int size = 200;
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        setup(kcp1, preset, mtu, wnd);
+        setup(kcp2, preset, mtu, wnd);
+
+        NetSimLink link;
+        link.delay_min = 20;
+        link.delay_max = 40;
+        link.loss_good = 0.02;
+        NetSim sim(1);
+        sim.attach(kcp1, kcp2, link, link);
+
+        std::vector<uint64_t> sent_us, latencies;
+        std::function<void()> tick = [&] {
+            char message[size] = {0};
+            uint32_t index = static_cast<uint32_t>(sent_us.size());
+            memcpy(message, &index, 4);
+            sent_us.push_back(sim.now_us());
+            kcp1.send(message, size);
+            if (sim.now() < 60000)
+                sim.at(sim.now() + 10, tick);
+        };
+        sim.at(0, tick);
+        sim.set_poll([&] {
+            char message[size];
+            while (kcp2.recv(message, size) > 0)
+            {
+                uint32_t index;
+                memcpy(&index, message, 4);
+                latencies.push_back(sim.now_us() - sent_us[index]);
+            }
+        });
+        sim.run(120000);
+
+        std::sort(latencies.begin(), latencies.end());
+        auto pct = [&latencies](double p) {
+            if (latencies.empty())
+                return -1.0;
+            size_t i = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+            return latencies[i] / 1e3;
+        };
+        printf("bench=latency preset=%s mtu=%d wnd=%u msg=%d sent=%zu received=%zu p50_ms=%.1f p99_ms=%.1f "
+               "p999_ms=%.1f\n",
+               preset.name, mtu, wnd, size, sent_us.size(), latencies.size(), pct(0.5), pct(0.99), pct(0.999));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t total = static_cast<size_t>(argc > 1 ? atoi(argv[1]) : 64) << 20;
+    for (const Preset &preset : presets)
+    {
+        for (int mtu : mtus)
+        {
+            for (uint32_t wnd : windows)
+            {
+                bulk(preset, mtu, wnd, total);
+                latency(preset, mtu, wnd);
+            }
+        }
+    }
+    return 0;
+}
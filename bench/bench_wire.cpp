@@ -0,0 +1,185 @@
+//=====================================================================
+//
+// bench_wire.cpp - header codec throughput
+//
+// Encodes and decodes 24-byte KCP headers in headers/sec: one at a
+// time, in batches over whole datagrams, and with a byte-by-byte
+// reference codec for comparison.
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "wire.h"
+
+using namespace stone;
+
+namespace
+{
+    const int DATAGRAMS = 4096;
+    const int ROUNDS = 200;
+    const int BATCH = 64;
+
+    double now_seconds()
+    {
+        using namespace std::chrono;
+        return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // the portable way without memcpy, one byte at a time
+    const char *reference_decode(const char *p, kcpHeader &header)
+    {
+        const uint8_t *u = reinterpret_cast<const uint8_t *>(p);
+        header.conv = u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+        header.cmd = u[4];
+        header.frg = u[5];
+        header.wnd = static_cast<uint16_t>(u[6] | (u[7] << 8));
+        header.ts = u[8] | (u[9] << 8) | (u[10] << 16) | (static_cast<uint32_t>(u[11]) << 24);
+        header.sn = u[12] | (u[13] << 8) | (u[14] << 16) | (static_cast<uint32_t>(u[15]) << 24);
+        header.una = u[16] | (u[17] << 8) | (u[18] << 16) | (static_cast<uint32_t>(u[19]) << 24);
+        header.len = u[20] | (u[21] << 8) | (u[22] << 16) | (static_cast<uint32_t>(u[23]) << 24);
+        return p + KCP_OVERHEAD;
+    }
+
+    struct Datagram
+    {
+        std::vector<char> bytes;
+        int headers = 0;
+    };
+
+    // mostly acks with some small pushes, like the reverse path of a transfer
+    std::vector<Datagram> make_datagrams(std::vector<kcpHeader> &headers)
+    {
+        std::vector<Datagram> datagrams(DATAGRAMS);
+        uint32_t sn = 1000;
+        for (auto &dg : datagrams)
+        {
+            dg.bytes.resize(1400);
+            char *p = dg.bytes.data();
+            char *end = p + dg.bytes.size();
+            while (end - p >= static_cast<long>(KCP_OVERHEAD) + 64)
+            {
+                kcpHeader h;
+                h.conv = 0x11223344;
+                h.cmd = static_cast<uint8_t>(rand() % 4 == 0 ? KCP_CMD_PUSH : KCP_CMD_ACK);
+                h.frg = 0;
+                h.wnd = 128;
+                h.ts = static_cast<uint32_t>(rand());
+                h.sn = sn++;
+                h.una = sn - 100;
+                h.len = h.cmd == KCP_CMD_PUSH ? static_cast<uint32_t>(rand() % 64) : 0;
+                headers.push_back(h);
+                p = wire_encode_header(p, h) + h.len;
+                dg.headers++;
+            }
+            dg.bytes.resize(p - dg.bytes.data());
+        }
+        return datagrams;
+    }
+
+    template <typename F>
+    void report(const char *name, long headers, F &&run)
+    {
+        double t0 = now_seconds();
+        uint32_t check = run();
+        double t1 = now_seconds();
+        printf("wire op=%s headers_per_sec=%.0f ns_per_header=%.2f check=%u\n", name, headers / (t1 - t0),
+               (t1 - t0) * 1e9 / headers, check);
+    }
+}
+
+int main()
+{
+    srand(1);
+    std::vector<kcpHeader> headers;
+    std::vector<Datagram> datagrams = make_datagrams(headers);
+    long total = static_cast<long>(headers.size()) * ROUNDS;
+    std::vector<char> out(headers.size() * KCP_OVERHEAD);
+
+    report("encode", total, [&] {
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            char *p = out.data();
+            for (auto &h : headers)
+            {
+                p = wire_encode_header(p, h);
+            }
+        }
+        return static_cast<uint32_t>(out[out.size() / 2]);
+    });
+
+    // every decoder fills an array of headers, as input() would consume them;
+    // decode and decode_reference trust the header count, decode_batch
+    // checks every length against the datagram size like input() does
+    report("decode", total, [&] {
+        uint32_t sum = 0;
+        kcpHeader batch[BATCH];
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (auto &dg : datagrams)
+            {
+                const char *p = dg.bytes.data();
+                for (int i = 0; i < dg.headers; i++)
+                {
+                    p = wire_decode_header(p, batch[i]) + batch[i].len;
+                }
+                for (int i = 0; i < dg.headers; i++)
+                {
+                    sum += batch[i].sn;
+                }
+            }
+        }
+        return sum;
+    });
+
+    report("decode_batch", total, [&] {
+        uint32_t sum = 0;
+        kcpHeader batch[BATCH];
+        uint32_t offsets[BATCH];
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (auto &dg : datagrams)
+            {
+                int n = wire_decode_headers(dg.bytes.data(), static_cast<uint32_t>(dg.bytes.size()), batch, offsets, BATCH);
+                for (int i = 0; i < n; i++)
+                {
+                    sum += batch[i].sn;
+                }
+            }
+        }
+        return sum;
+    });
+
+    report("decode_reference", total, [&] {
+        uint32_t sum = 0;
+        kcpHeader batch[BATCH];
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (auto &dg : datagrams)
+            {
+                const char *p = dg.bytes.data();
+                for (int i = 0; i < dg.headers; i++)
+                {
+                    p = reference_decode(p, batch[i]) + batch[i].len;
+                }
+                for (int i = 0; i < dg.headers; i++)
+                {
+                    sum += batch[i].sn;
+                }
+            }
+        }
+        return sum;
+    });
+
+    // the bytes must not depend on the host
+    const unsigned char expect[KCP_OVERHEAD] = {0x44, 0x33, 0x22, 0x11, 81, 2, 0x80, 0x00, 4, 3, 2, 1,
+                                                8, 7, 6, 5, 12, 11, 10, 9, 16, 0, 0, 0};
+    kcpHeader h = {0x11223344, 81, 2, 128, 0x01020304, 0x05060708, 0x090a0b0c, 16};
+    char bytes[KCP_OVERHEAD];
+    wire_encode_header(bytes, h);
+    printf("wire layout=%s\n", memcmp(bytes, expect, KCP_OVERHEAD) == 0 ? "ok" : "mismatch");
+    return 0;
+}
@@ -0,0 +1,703 @@
+#include "aead.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AEAD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define AEAD_AVX2 1
+#include <immintrin.h>
+#endif
+
+using namespace stone;
+
+namespace
+{
+    const int CHACHA_BLOCK = 64;
+    const int POLY_BLOCK = 16;
+
+    bool simd_enabled = true;
+
+    inline uint32_t load32(const uint8_t *p)
+    {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    inline void store32(uint8_t *p, uint32_t v)
+    {
+        p[0] = static_cast<uint8_t>(v);
+        p[1] = static_cast<uint8_t>(v >> 8);
+        p[2] = static_cast<uint8_t>(v >> 16);
+        p[3] = static_cast<uint8_t>(v >> 24);
+    }
+
+    inline uint64_t load64(const uint8_t *p)
+    {
+        return static_cast<uint64_t>(load32(p)) | (static_cast<uint64_t>(load32(p + 4)) << 32);
+    }
+
+    inline void store64(uint8_t *p, uint64_t v)
+    {
+        store32(p, static_cast<uint32_t>(v));
+        store32(p + 4, static_cast<uint32_t>(v >> 32));
+    }
+
+    //---------------------------------------------------------------------
+    // ChaCha20
+    //---------------------------------------------------------------------
+
+    void chacha_init(uint32_t state[16], const uint8_t *key, const uint8_t *nonce, uint32_t counter)
+    {
+        state[0] = 0x61707865; // "expand 32-byte k"
+        state[1] = 0x3320646e;
+        state[2] = 0x79622d32;
+        state[3] = 0x6b206574;
+        for (int i = 0; i < 8; i++)
+        {
+            state[4 + i] = load32(key + i * 4);
+        }
+        state[12] = counter;
+        state[13] = load32(nonce);
+        state[14] = load32(nonce + 4);
+        state[15] = load32(nonce + 8);
+    }
+
+    inline uint32_t rotl(uint32_t v, int n)
+    {
+        return (v << n) | (v >> (32 - n));
+    }
+
+    inline void quarter(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d)
+    {
+        a += b; d = rotl(d ^ a, 16);
+        c += d; b = rotl(b ^ c, 12);
+        a += b; d = rotl(d ^ a, 8);
+        c += d; b = rotl(b ^ c, 7);
+    }
+
+    // the 20 rounds, without the final addition
+    void chacha_rounds(uint32_t x[16])
+    {
+        for (int i = 0; i < 10; i++)
+        {
+            quarter(x[0], x[4], x[8], x[12]);
+            quarter(x[1], x[5], x[9], x[13]);
+            quarter(x[2], x[6], x[10], x[14]);
+            quarter(x[3], x[7], x[11], x[15]);
+            quarter(x[0], x[5], x[10], x[15]);
+            quarter(x[1], x[6], x[11], x[12]);
+            quarter(x[2], x[7], x[8], x[13]);
+            quarter(x[3], x[4], x[9], x[14]);
+        }
+    }
+
+    void chacha_block(const uint32_t state[16], uint8_t out[CHACHA_BLOCK])
+    {
+        uint32_t x[16];
+        memcpy(x, state, sizeof(x));
+        chacha_rounds(x);
+        for (int i = 0; i < 16; i++)
+        {
+            store32(out + i * 4, x[i] + state[i]);
+        }
+    }
+
+    // one block at a time, also the tail of the vectorized kernels
+    void chacha_scalar(uint32_t state[16], const uint8_t *src, uint8_t *dst, int len)
+    {
+        uint8_t block[CHACHA_BLOCK];
+        while (len > 0)
+        {
+            chacha_block(state, block);
+            state[12]++;
+            int n = len < CHACHA_BLOCK ? len : CHACHA_BLOCK;
+            for (int i = 0; i < n; i++)
+            {
+                dst[i] = src[i] ^ block[i];
+            }
+            src += n;
+            dst += n;
+            len -= n;
+        }
+    }
+
+#ifdef AEAD_SSE2
+    template <int N>
+    inline __m128i rotl128(__m128i v)
+    {
+        return _mm_or_si128(_mm_slli_epi32(v, N), _mm_srli_epi32(v, 32 - N));
+    }
+
+    inline void quarter128(__m128i &a, __m128i &b, __m128i &c, __m128i &d)
+    {
+        a = _mm_add_epi32(a, b); d = rotl128<16>(_mm_xor_si128(d, a));
+        c = _mm_add_epi32(c, d); b = rotl128<12>(_mm_xor_si128(b, c));
+        a = _mm_add_epi32(a, b); d = rotl128<8>(_mm_xor_si128(d, a));
+        c = _mm_add_epi32(c, d); b = rotl128<7>(_mm_xor_si128(b, c));
+    }
+
+    // 4 blocks per round, lane i of word j is word j of block i
+    void chacha_sse2(uint32_t state[16], const uint8_t *src, uint8_t *dst, int len)
+    {
+        while (len >= 4 * CHACHA_BLOCK)
+        {
+            __m128i s[16], x[16];
+            for (int i = 0; i < 16; i++)
+            {
+                s[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+            }
+            s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+            for (int i = 0; i < 16; i++)
+            {
+                x[i] = s[i];
+            }
+
+            for (int i = 0; i < 10; i++)
+            {
+                quarter128(x[0], x[4], x[8], x[12]);
+                quarter128(x[1], x[5], x[9], x[13]);
+                quarter128(x[2], x[6], x[10], x[14]);
+                quarter128(x[3], x[7], x[11], x[15]);
+                quarter128(x[0], x[5], x[10], x[15]);
+                quarter128(x[1], x[6], x[11], x[12]);
+                quarter128(x[2], x[7], x[8], x[13]);
+                quarter128(x[3], x[4], x[9], x[14]);
+            }
+
+            // transpose each group of 4 words back to block order
+            for (int g = 0; g < 4; g++)
+            {
+                __m128i a = _mm_add_epi32(x[g * 4 + 0], s[g * 4 + 0]);
+                __m128i b = _mm_add_epi32(x[g * 4 + 1], s[g * 4 + 1]);
+                __m128i c = _mm_add_epi32(x[g * 4 + 2], s[g * 4 + 2]);
+                __m128i d = _mm_add_epi32(x[g * 4 + 3], s[g * 4 + 3]);
+                __m128i ab0 = _mm_unpacklo_epi32(a, b);
+                __m128i ab1 = _mm_unpackhi_epi32(a, b);
+                __m128i cd0 = _mm_unpacklo_epi32(c, d);
+                __m128i cd1 = _mm_unpackhi_epi32(c, d);
+                __m128i blk[4] = {_mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+                                  _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)};
+                for (int k = 0; k < 4; k++)
+                {
+                    int offset = k * CHACHA_BLOCK + g * 16;
+                    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + offset));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + offset), _mm_xor_si128(in, blk[k]));
+                }
+            }
+
+            state[12] += 4;
+            src += 4 * CHACHA_BLOCK;
+            dst += 4 * CHACHA_BLOCK;
+            len -= 4 * CHACHA_BLOCK;
+        }
+        chacha_scalar(state, src, dst, len);
+    }
+#endif
+
+#ifdef AEAD_AVX2
+    template <int N>
+    __attribute__((target("avx2"))) inline __m256i rotl256(__m256i v)
+    {
+        return _mm256_or_si256(_mm256_slli_epi32(v, N), _mm256_srli_epi32(v, 32 - N));
+    }
+
+    // rotations by whole bytes are a single shuffle
+    __attribute__((target("avx2"))) inline __m256i rotl256_16(__m256i v)
+    {
+        const __m256i r16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                            13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+        return _mm256_shuffle_epi8(v, r16);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i rotl256_8(__m256i v)
+    {
+        const __m256i r8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                           14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+        return _mm256_shuffle_epi8(v, r8);
+    }
+
+    __attribute__((target("avx2"))) inline void quarter256(__m256i &a, __m256i &b, __m256i &c, __m256i &d)
+    {
+        a = _mm256_add_epi32(a, b); d = rotl256_16(_mm256_xor_si256(d, a));
+        c = _mm256_add_epi32(c, d); b = rotl256<12>(_mm256_xor_si256(b, c));
+        a = _mm256_add_epi32(a, b); d = rotl256_8(_mm256_xor_si256(d, a));
+        c = _mm256_add_epi32(c, d); b = rotl256<7>(_mm256_xor_si256(b, c));
+    }
+
+    // 8 blocks per round, lane i of word j is word j of block i
+    __attribute__((target("avx2"))) void chacha_avx2(uint32_t state[16], const uint8_t *src, uint8_t *dst, int len)
+    {
+        while (len >= 8 * CHACHA_BLOCK)
+        {
+            __m256i s[16], x[16];
+            for (int i = 0; i < 16; i++)
+            {
+                s[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+            }
+            s[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+            for (int i = 0; i < 16; i++)
+            {
+                x[i] = s[i];
+            }
+
+            for (int i = 0; i < 10; i++)
+            {
+                quarter256(x[0], x[4], x[8], x[12]);
+                quarter256(x[1], x[5], x[9], x[13]);
+                quarter256(x[2], x[6], x[10], x[14]);
+                quarter256(x[3], x[7], x[11], x[15]);
+                quarter256(x[0], x[5], x[10], x[15]);
+                quarter256(x[1], x[6], x[11], x[12]);
+                quarter256(x[2], x[7], x[8], x[13]);
+                quarter256(x[3], x[4], x[9], x[14]);
+            }
+
+            // transpose 4x4 inside each 128-bit half: blk[g][k] holds words
+            // g*4..g*4+3 of block k (low half) and block k+4 (high half)
+            __m256i blk[4][4];
+            for (int g = 0; g < 4; g++)
+            {
+                __m256i a = _mm256_add_epi32(x[g * 4 + 0], s[g * 4 + 0]);
+                __m256i b = _mm256_add_epi32(x[g * 4 + 1], s[g * 4 + 1]);
+                __m256i c = _mm256_add_epi32(x[g * 4 + 2], s[g * 4 + 2]);
+                __m256i d = _mm256_add_epi32(x[g * 4 + 3], s[g * 4 + 3]);
+                __m256i ab0 = _mm256_unpacklo_epi32(a, b);
+                __m256i ab1 = _mm256_unpackhi_epi32(a, b);
+                __m256i cd0 = _mm256_unpacklo_epi32(c, d);
+                __m256i cd1 = _mm256_unpackhi_epi32(c, d);
+                blk[g][0] = _mm256_unpacklo_epi64(ab0, cd0);
+                blk[g][1] = _mm256_unpackhi_epi64(ab0, cd0);
+                blk[g][2] = _mm256_unpacklo_epi64(ab1, cd1);
+                blk[g][3] = _mm256_unpackhi_epi64(ab1, cd1);
+            }
+            for (int k = 0; k < 4; k++)
+            {
+                for (int g = 0; g < 4; g += 2)
+                {
+                    __m256i lo = _mm256_permute2x128_si256(blk[g][k], blk[g + 1][k], 0x20);
+                    __m256i hi = _mm256_permute2x128_si256(blk[g][k], blk[g + 1][k], 0x31);
+                    int off_lo = k * CHACHA_BLOCK + g * 16;
+                    int off_hi = (k + 4) * CHACHA_BLOCK + g * 16;
+                    __m256i in_lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + off_lo));
+                    __m256i in_hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + off_hi));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + off_lo), _mm256_xor_si256(in_lo, lo));
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + off_hi), _mm256_xor_si256(in_hi, hi));
+                }
+            }
+
+            state[12] += 8;
+            src += 8 * CHACHA_BLOCK;
+            dst += 8 * CHACHA_BLOCK;
+            len -= 8 * CHACHA_BLOCK;
+        }
+#ifdef AEAD_SSE2
+        chacha_sse2(state, src, dst, len);
+#else
+        chacha_scalar(state, src, dst, len);
+#endif
+    }
+
+    bool has_avx2()
+    {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+    }
+#endif
+
+    void chacha_xor(uint32_t state[16], const uint8_t *src, uint8_t *dst, int len)
+    {
+#ifdef AEAD_AVX2
+        if (simd_enabled && has_avx2())
+        {
+            chacha_avx2(state, src, dst, len);
+            return;
+        }
+#endif
+#ifdef AEAD_SSE2
+        if (simd_enabled)
+        {
+            chacha_sse2(state, src, dst, len);
+            return;
+        }
+#endif
+        chacha_scalar(state, src, dst, len);
+    }
+
+    //---------------------------------------------------------------------
+    // Poly1305
+    //---------------------------------------------------------------------
+
+#if defined(__SIZEOF_INT128__)
+    // 3 limbs of 44/44/42 bits, 128-bit products
+    class Poly1305
+    {
+    public:
+        explicit Poly1305(const uint8_t key[32])
+        {
+            uint64_t t0 = load64(key);
+            uint64_t t1 = load64(key + 8);
+            r_[0] = t0 & 0xffc0fffffff;
+            r_[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+            r_[2] = (t1 >> 24) & 0x00ffffffc0f;
+            h_[0] = h_[1] = h_[2] = 0;
+            pad_[0] = load64(key + 16);
+            pad_[1] = load64(key + 24);
+        }
+
+        // len is a multiple of POLY_BLOCK
+        void blocks(const uint8_t *m, int len)
+        {
+            const uint64_t mask44 = 0xfffffffffff, mask42 = 0x3ffffffffff;
+            uint64_t r0 = r_[0], r1 = r_[1], r2 = r_[2];
+            uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+            uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+
+            for (; len >= POLY_BLOCK; len -= POLY_BLOCK, m += POLY_BLOCK)
+            {
+                uint64_t t0 = load64(m);
+                uint64_t t1 = load64(m + 8);
+                h0 += t0 & mask44;
+                h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+                h2 += (((t1 >> 24)) & mask42) | (static_cast<uint64_t>(1) << 40);
+
+                unsigned __int128 d0 = static_cast<unsigned __int128>(h0) * r0 +
+                                       static_cast<unsigned __int128>(h1) * s2 +
+                                       static_cast<unsigned __int128>(h2) * s1;
+                unsigned __int128 d1 = static_cast<unsigned __int128>(h0) * r1 +
+                                       static_cast<unsigned __int128>(h1) * r0 +
+                                       static_cast<unsigned __int128>(h2) * s2;
+                unsigned __int128 d2 = static_cast<unsigned __int128>(h0) * r2 +
+                                       static_cast<unsigned __int128>(h1) * r1 +
+                                       static_cast<unsigned __int128>(h2) * r0;
+
+                uint64_t c = static_cast<uint64_t>(d0 >> 44);
+                h0 = static_cast<uint64_t>(d0) & mask44;
+                d1 += c;
+                c = static_cast<uint64_t>(d1 >> 44);
+                h1 = static_cast<uint64_t>(d1) & mask44;
+                d2 += c;
+                c = static_cast<uint64_t>(d2 >> 42);
+                h2 = static_cast<uint64_t>(d2) & mask42;
+                h0 += c * 5;
+                c = h0 >> 44;
+                h0 &= mask44;
+                h1 += c;
+            }
+            h_[0] = h0;
+            h_[1] = h1;
+            h_[2] = h2;
+        }
+
+        void finish(uint8_t tag[16])
+        {
+            const uint64_t mask44 = 0xfffffffffff, mask42 = 0x3ffffffffff;
+            uint64_t h0 = h_[0], h1 = h_[1], h2 = h_[2];
+
+            uint64_t c = h1 >> 44;
+            h1 &= mask44;
+            h2 += c;
+            c = h2 >> 42;
+            h2 &= mask42;
+            h0 += c * 5;
+            c = h0 >> 44;
+            h0 &= mask44;
+            h1 += c;
+            c = h1 >> 44;
+            h1 &= mask44;
+            h2 += c;
+            c = h2 >> 42;
+            h2 &= mask42;
+            h0 += c * 5;
+            c = h0 >> 44;
+            h0 &= mask44;
+            h1 += c;
+
+            // h - p, kept if it does not underflow
+            uint64_t g0 = h0 + 5;
+            c = g0 >> 44;
+            g0 &= mask44;
+            uint64_t g1 = h1 + c;
+            c = g1 >> 44;
+            g1 &= mask44;
+            uint64_t g2 = h2 + c - (static_cast<uint64_t>(1) << 42);
+
+            c = (g2 >> 63) - 1;
+            g0 &= c;
+            g1 &= c;
+            g2 &= c;
+            c = ~c;
+            h0 = (h0 & c) | g0;
+            h1 = (h1 & c) | g1;
+            h2 = (h2 & c) | g2;
+
+            uint64_t t0 = pad_[0], t1 = pad_[1];
+            h0 += t0 & mask44;
+            c = h0 >> 44;
+            h0 &= mask44;
+            h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + c;
+            c = h1 >> 44;
+            h1 &= mask44;
+            h2 += (((t1 >> 24)) & mask42) + c;
+            h2 &= mask42;
+
+            store64(tag, h0 | (h1 << 44));
+            store64(tag + 8, (h1 >> 20) | (h2 << 24));
+        }
+
+    private:
+        uint64_t r_[3], h_[3], pad_[2];
+    };
+#else
+    // 5 limbs of 26 bits, 64-bit products
+    class Poly1305
+    {
+    public:
+        explicit Poly1305(const uint8_t key[32])
+        {
+            r_[0] = (load32(key + 0)) & 0x3ffffff;
+            r_[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+            r_[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+            r_[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+            r_[4] = (load32(key + 12) >> 8) & 0x00fffff;
+            for (int i = 0; i < 5; i++)
+            {
+                h_[i] = 0;
+            }
+            for (int i = 0; i < 4; i++)
+            {
+                pad_[i] = load32(key + 16 + i * 4);
+            }
+        }
+
+        // len is a multiple of POLY_BLOCK
+        void blocks(const uint8_t *m, int len)
+        {
+            const uint32_t mask26 = 0x3ffffff;
+            uint32_t r0 = r_[0], r1 = r_[1], r2 = r_[2], r3 = r_[3], r4 = r_[4];
+            uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+            uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+            for (; len >= POLY_BLOCK; len -= POLY_BLOCK, m += POLY_BLOCK)
+            {
+                h0 += (load32(m + 0)) & mask26;
+                h1 += (load32(m + 3) >> 2) & mask26;
+                h2 += (load32(m + 6) >> 4) & mask26;
+                h3 += (load32(m + 9) >> 6) & mask26;
+                h4 += (load32(m + 12) >> 8) | (1 << 24);
+
+                uint64_t d0 = static_cast<uint64_t>(h0) * r0 + static_cast<uint64_t>(h1) * s4 +
+                              static_cast<uint64_t>(h2) * s3 + static_cast<uint64_t>(h3) * s2 +
+                              static_cast<uint64_t>(h4) * s1;
+                uint64_t d1 = static_cast<uint64_t>(h0) * r1 + static_cast<uint64_t>(h1) * r0 +
+                              static_cast<uint64_t>(h2) * s4 + static_cast<uint64_t>(h3) * s3 +
+                              static_cast<uint64_t>(h4) * s2;
+                uint64_t d2 = static_cast<uint64_t>(h0) * r2 + static_cast<uint64_t>(h1) * r1 +
+                              static_cast<uint64_t>(h2) * r0 + static_cast<uint64_t>(h3) * s4 +
+                              static_cast<uint64_t>(h4) * s3;
+                uint64_t d3 = static_cast<uint64_t>(h0) * r3 + static_cast<uint64_t>(h1) * r2 +
+                              static_cast<uint64_t>(h2) * r1 + static_cast<uint64_t>(h3) * r0 +
+                              static_cast<uint64_t>(h4) * s4;
+                uint64_t d4 = static_cast<uint64_t>(h0) * r4 + static_cast<uint64_t>(h1) * r3 +
+                              static_cast<uint64_t>(h2) * r2 + static_cast<uint64_t>(h3) * r1 +
+                              static_cast<uint64_t>(h4) * r0;
+
+                uint32_t c = static_cast<uint32_t>(d0 >> 26);
+                h0 = static_cast<uint32_t>(d0) & mask26;
+                d1 += c;
+                c = static_cast<uint32_t>(d1 >> 26);
+                h1 = static_cast<uint32_t>(d1) & mask26;
+                d2 += c;
+                c = static_cast<uint32_t>(d2 >> 26);
+                h2 = static_cast<uint32_t>(d2) & mask26;
+                d3 += c;
+                c = static_cast<uint32_t>(d3 >> 26);
+                h3 = static_cast<uint32_t>(d3) & mask26;
+                d4 += c;
+                c = static_cast<uint32_t>(d4 >> 26);
+                h4 = static_cast<uint32_t>(d4) & mask26;
+                h0 += c * 5;
+                c = h0 >> 26;
+                h0 &= mask26;
+                h1 += c;
+            }
+            h_[0] = h0;
+            h_[1] = h1;
+            h_[2] = h2;
+            h_[3] = h3;
+            h_[4] = h4;
+        }
+
+        void finish(uint8_t tag[16])
+        {
+            const uint32_t mask26 = 0x3ffffff;
+            uint32_t h0 = h_[0], h1 = h_[1], h2 = h_[2], h3 = h_[3], h4 = h_[4];
+
+            uint32_t c = h1 >> 26;
+            h1 &= mask26;
+            h2 += c;
+            c = h2 >> 26;
+            h2 &= mask26;
+            h3 += c;
+            c = h3 >> 26;
+            h3 &= mask26;
+            h4 += c;
+            c = h4 >> 26;
+            h4 &= mask26;
+            h0 += c * 5;
+            c = h0 >> 26;
+            h0 &= mask26;
+            h1 += c;
+
+            // h - p, kept if it does not underflow
+            uint32_t g0 = h0 + 5;
+            c = g0 >> 26;
+            g0 &= mask26;
+            uint32_t g1 = h1 + c;
+            c = g1 >> 26;
+            g1 &= mask26;
+            uint32_t g2 = h2 + c;
+            c = g2 >> 26;
+            g2 &= mask26;
+            uint32_t g3 = h3 + c;
+            c = g3 >> 26;
+            g3 &= mask26;
+            uint32_t g4 = h4 + c - (1 << 26);
+
+            uint32_t mask = (g4 >> 31) - 1;
+            g0 &= mask;
+            g1 &= mask;
+            g2 &= mask;
+            g3 &= mask;
+            g4 &= mask;
+            mask = ~mask;
+            h0 = (h0 & mask) | g0;
+            h1 = (h1 & mask) | g1;
+            h2 = (h2 & mask) | g2;
+            h3 = (h3 & mask) | g3;
+            h4 = (h4 & mask) | g4;
+
+            h0 = h0 | (h1 << 26);
+            h1 = (h1 >> 6) | (h2 << 20);
+            h2 = (h2 >> 12) | (h3 << 14);
+            h3 = (h3 >> 18) | (h4 << 8);
+
+            uint64_t f = static_cast<uint64_t>(h0) + pad_[0];
+            store32(tag, static_cast<uint32_t>(f));
+            f = static_cast<uint64_t>(h1) + pad_[1] + (f >> 32);
+            store32(tag + 4, static_cast<uint32_t>(f));
+            f = static_cast<uint64_t>(h2) + pad_[2] + (f >> 32);
+            store32(tag + 8, static_cast<uint32_t>(f));
+            f = static_cast<uint64_t>(h3) + pad_[3] + (f >> 32);
+            store32(tag + 12, static_cast<uint32_t>(f));
+        }
+
+    private:
+        uint32_t r_[5], h_[5], pad_[4];
+    };
+#endif
+
+    // poly1305 over m zero padded to a multiple of 16
+    void poly_padded(Poly1305 &poly, const uint8_t *m, int len)
+    {
+        int full = len & ~(POLY_BLOCK - 1);
+        poly.blocks(m, full);
+        if (full < len)
+        {
+            uint8_t block[POLY_BLOCK] = {0};
+            memcpy(block, m + full, len - full);
+            poly.blocks(block, POLY_BLOCK);
+        }
+    }
+
+    // RFC 8439 2.8: the one time key is the first block, data starts at block 1
+    void aead_tag(const uint8_t *key, const uint8_t *nonce, const uint8_t *ad, int adlen,
+                  const uint8_t *cipher, int len, uint8_t tag[16])
+    {
+        uint32_t state[16];
+        uint8_t block[CHACHA_BLOCK];
+        chacha_init(state, key, nonce, 0);
+        chacha_block(state, block);
+
+        Poly1305 poly(block);
+        poly_padded(poly, ad, adlen);
+        poly_padded(poly, cipher, len);
+        uint8_t lengths[POLY_BLOCK];
+        store64(lengths, static_cast<uint64_t>(adlen));
+        store64(lengths + 8, static_cast<uint64_t>(len));
+        poly.blocks(lengths, POLY_BLOCK);
+        poly.finish(tag);
+    }
+}
+
+void stone::chacha20_xor(const uint8_t *key, const uint8_t *nonce, uint32_t counter,
+                         const char *src, char *dst, int len)
+{
+    uint32_t state[16];
+    chacha_init(state, key, nonce, counter);
+    chacha_xor(state, reinterpret_cast<const uint8_t *>(src), reinterpret_cast<uint8_t *>(dst), len);
+}
+
+// the nonce takes the place of the counter and the 12 byte nonce, the
+// key is the first and the last row of the state after the rounds
+void stone::hchacha20(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey)
+{
+    uint32_t x[16];
+    chacha_init(x, key, nonce + 4, load32(nonce));
+    chacha_rounds(x);
+    for (int i = 0; i < 4; i++)
+    {
+        store32(subkey + i * 4, x[i]);
+        store32(subkey + 16 + i * 4, x[12 + i]);
+    }
+}
+
+void stone::aead_seal(const uint8_t *key, const uint8_t *nonce, const char *ad, int adlen,
+                      char *data, int len, uint8_t *tag)
+{
+    chacha20_xor(key, nonce, 1, data, data, len);
+    aead_tag(key, nonce, reinterpret_cast<const uint8_t *>(ad), adlen,
+             reinterpret_cast<const uint8_t *>(data), len, tag);
+}
+
+bool stone::aead_open(const uint8_t *key, const uint8_t *nonce, const char *ad, int adlen,
+                      const char *src, int len, const uint8_t *tag, char *dst)
+{
+    uint8_t expect[AEAD_TAG_LEN];
+    aead_tag(key, nonce, reinterpret_cast<const uint8_t *>(ad), adlen,
+             reinterpret_cast<const uint8_t *>(src), len, expect);
+
+    // constant time compare
+    uint8_t diff = 0;
+    for (int i = 0; i < AEAD_TAG_LEN; i++)
+    {
+        diff |= expect[i] ^ tag[i];
+    }
+    if (diff != 0)
+    {
+        return false;
+    }
+    chacha20_xor(key, nonce, 1, src, dst, len);
+    return true;
+}
+
+const char *stone::aead_impl()
+{
+#ifdef AEAD_AVX2
+    if (simd_enabled && has_avx2())
+        return "avx2";
+#endif
+#ifdef AEAD_SSE2
+    if (simd_enabled)
+        return "sse2";
+#endif
+    return "scalar";
+}
+
+void stone::aead_set_simd(bool enable)
+{
+    simd_enabled = enable;
+}
@@ -0,0 +1,43 @@
+#ifndef STONE_AEAD_H
+#define STONE_AEAD_H
+#include <cstdint>
+
+namespace stone
+{
+    // ChaCha20-Poly1305 (RFC 8439). The ChaCha20 keystream is generated 8
+    // blocks at a time with AVX2 or 4 with SSE2 when the cpu has them, one
+    // block at a time otherwise.
+
+    const int AEAD_KEY_LEN = 32;
+    const int AEAD_NONCE_LEN = 12;
+    const int AEAD_TAG_LEN = 16;
+    const int HCHACHA_NONCE_LEN = 16;
+
+    // xor len bytes of src with the keystream starting at block counter
+    // into dst, src and dst may be the same
+    void chacha20_xor(const uint8_t *key, const uint8_t *nonce, uint32_t counter,
+                      const char *src, char *dst, int len);
+
+    // HChaCha20 (draft-irtf-cfrg-xchacha): a subkey from key and a 16 byte
+    // nonce. Sealing under it with the remaining 8 nonce bytes after 4 zero
+    // bytes is XChaCha20-Poly1305, whose 24 byte nonces may be random.
+    void hchacha20(const uint8_t *key, const uint8_t *nonce, uint8_t *subkey);
+
+    // encrypt data in place and write the tag over ad and the ciphertext
+    void aead_seal(const uint8_t *key, const uint8_t *nonce, const char *ad, int adlen,
+                   char *data, int len, uint8_t *tag);
+
+    // check the tag, then decrypt src into dst (may be the same);
+    // returns false and leaves dst untouched if the tag does not match
+    bool aead_open(const uint8_t *key, const uint8_t *nonce, const char *ad, int adlen,
+                   const char *src, int len, const uint8_t *tag, char *dst);
+
+    // "avx2", "sse2" or "scalar", the ChaCha20 kernel in use
+    const char *aead_impl();
+
+    // use the vectorized kernels when the cpu supports them (the default),
+    // or force the scalar one
+    void aead_set_simd(bool enable);
+}
+
+#endif
@@ -0,0 +1,225 @@
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+using namespace stone;
+
+namespace
+{
+    const uint32_t CRC32C_POLY = 0x82f63b78; // reflected
+
+    bool hw_enabled = true;
+
+    struct SliceTable
+    {
+        uint32_t t[8][256];
+
+        SliceTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+                }
+                t[0][i] = crc;
+            }
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                for (int k = 1; k < 8; k++)
+                {
+                    t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+                }
+            }
+        }
+    };
+
+    uint32_t crc_slice8(uint32_t crc, const uint8_t *p, int len)
+    {
+        static const SliceTable table;
+        const uint32_t(*t)[256] = table.t;
+
+        while (len >= 8)
+        {
+            uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                                 (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24));
+            crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                  t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+            p += 8;
+            len -= 8;
+        }
+        while (len-- > 0)
+        {
+            crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+        }
+        return crc;
+    }
+
+#ifdef CRC32C_SSE42
+    // the crc32 instruction has a latency of 3 and a throughput of 1, so
+    // three streams run in parallel and are combined by shifting the
+    // first ones over the length of the others
+    const int CRC32C_LONG = 1024;
+    const int CRC32C_SHORT = 64;
+
+    // gf(2) 32x32 matrix times vector
+    uint32_t gf2_times(const uint32_t *mat, uint32_t vec)
+    {
+        uint32_t sum = 0;
+        for (; vec != 0; vec >>= 1, mat++)
+        {
+            if (vec & 1)
+                sum ^= *mat;
+        }
+        return sum;
+    }
+
+    void gf2_square(uint32_t *square, const uint32_t *mat)
+    {
+        for (int n = 0; n < 32; n++)
+        {
+            square[n] = gf2_times(mat, mat[n]);
+        }
+    }
+
+    // table to apply the operator of appending len zero bytes to a crc
+    struct ZerosTable
+    {
+        uint32_t t[4][256];
+
+        explicit ZerosTable(int len)
+        {
+            uint32_t even[32], odd[32];
+            odd[0] = CRC32C_POLY; // one zero bit
+            for (int n = 1; n < 32; n++)
+            {
+                odd[n] = 1u << (n - 1);
+            }
+            gf2_square(even, odd); // two zero bits
+            gf2_square(odd, even); // four zero bits
+
+            // square up to len bytes, the first squaring gives one byte
+            const uint32_t *op = odd;
+            do
+            {
+                gf2_square(even, odd);
+                op = even;
+                len >>= 1;
+                if (len == 0)
+                    break;
+                gf2_square(odd, even);
+                op = odd;
+                len >>= 1;
+            } while (len != 0);
+
+            for (uint32_t n = 0; n < 256; n++)
+            {
+                t[0][n] = gf2_times(op, n);
+                t[1][n] = gf2_times(op, n << 8);
+                t[2][n] = gf2_times(op, n << 16);
+                t[3][n] = gf2_times(op, n << 24);
+            }
+        }
+
+        uint32_t shift(uint32_t crc) const
+        {
+            return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^ t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+        }
+    };
+
+    __attribute__((target("sse4.2"))) inline uint64_t crc_word(uint64_t crc, const uint8_t *p)
+    {
+#ifdef __x86_64__
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        return _mm_crc32_u64(crc, v);
+#else
+        uint32_t lo, hi;
+        memcpy(&lo, p, sizeof(lo));
+        memcpy(&hi, p + 4, sizeof(hi));
+        return _mm_crc32_u32(_mm_crc32_u32(static_cast<uint32_t>(crc), lo), hi);
+#endif
+    }
+
+    // crc of three blocks of len bytes in parallel
+    __attribute__((target("sse4.2"))) uint32_t crc_blocks3(uint32_t crc, const uint8_t *&p, int len,
+                                                            const ZerosTable &zeros)
+    {
+        uint64_t crc0 = crc, crc1 = 0, crc2 = 0;
+        for (const uint8_t *end = p + len; p < end; p += 8)
+        {
+            crc0 = crc_word(crc0, p);
+            crc1 = crc_word(crc1, p + len);
+            crc2 = crc_word(crc2, p + len * 2);
+        }
+        p += len * 2;
+        crc = zeros.shift(static_cast<uint32_t>(crc0)) ^ static_cast<uint32_t>(crc1);
+        return zeros.shift(crc) ^ static_cast<uint32_t>(crc2);
+    }
+
+    __attribute__((target("sse4.2"))) uint32_t crc_sse42(uint32_t crc, const uint8_t *p, int len)
+    {
+        static const ZerosTable long_zeros(CRC32C_LONG);
+        static const ZerosTable short_zeros(CRC32C_SHORT);
+
+        for (; len >= CRC32C_LONG * 3; len -= CRC32C_LONG * 3)
+        {
+            crc = crc_blocks3(crc, p, CRC32C_LONG, long_zeros);
+        }
+        for (; len >= CRC32C_SHORT * 3; len -= CRC32C_SHORT * 3)
+        {
+            crc = crc_blocks3(crc, p, CRC32C_SHORT, short_zeros);
+        }
+        uint64_t crc64 = crc;
+        for (; len >= 8; len -= 8, p += 8)
+        {
+            crc64 = crc_word(crc64, p);
+        }
+        crc = static_cast<uint32_t>(crc64);
+        while (len-- > 0)
+        {
+            crc = _mm_crc32_u8(crc, *p++);
+        }
+        return crc;
+    }
+
+    bool has_sse42()
+    {
+        static const bool sse42 = __builtin_cpu_supports("sse4.2");
+        return sse42;
+    }
+#endif
+}
+
+uint32_t stone::crc32c(uint32_t crc, const char *data, int len)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    crc = ~crc;
+#ifdef CRC32C_SSE42
+    if (hw_enabled && has_sse42())
+    {
+        return ~crc_sse42(crc, p, len);
+    }
+#endif
+    return ~crc_slice8(crc, p, len);
+}
+
+const char *stone::crc32c_impl()
+{
+#ifdef CRC32C_SSE42
+    if (hw_enabled && has_sse42())
+        return "sse4.2";
+#endif
+    return "slice8";
+}
+
+void stone::crc32c_set_hw(bool enable)
+{
+    hw_enabled = enable;
+}
@@ -0,0 +1,21 @@
+#ifndef STONE_CRC32C_H
+#define STONE_CRC32C_H
+#include <cstdint>
+
+namespace stone
+{
+    // CRC32C (Castagnoli), with the SSE4.2 crc32 instruction when the cpu
+    // has it, slicing-by-8 tables otherwise.
+
+    // crc of len bytes, continuing from crc (0 to start)
+    uint32_t crc32c(uint32_t crc, const char *data, int len);
+
+    // "sse4.2" or "slice8", the implementation in use
+    const char *crc32c_impl();
+
+    // use the crc32 instruction when the cpu supports it (the default),
+    // or force the tables
+    void crc32c_set_hw(bool enable);
+}
+
+#endif
@@ -3,12 +3,22 @@
 #include <cstdint>
 #include <functional>
 #include <list>
+#include <map>
+#include <unordered_map>
 #include <memory>
 #include <vector>
 #include <array>
+#include <atomic>
+#include <deque>
+#include <cassert>
 
 #include <cstring>
 
+#include "aead.h"
+#include "crc32c.h"
+#include "profile.h"
+#include "trace.h"
+
 #ifndef IWORDS_BIG_ENDIAN
 #ifdef _BIG_ENDIAN_
 #if _BIG_ENDIAN_
@@ -30,6 +40,18 @@
 #endif
 #endif
 
+// counters of stats(), 0 compiles them out. It changes the layout of
+// BasicKcpp, so it must be the same for every translation unit.
+#ifndef KCP_STATS
+#define KCP_STATS 1
+#endif
+
+// per-phase timing of flush() and input() for profile(), off by default,
+// the same layout rule as KCP_STATS applies
+#ifndef KCP_PROFILE
+#define KCP_PROFILE 0
+#endif
+
 #ifndef IWORDS_MUST_ALIGN
 #if defined(__i386__) || defined(__i386) || defined(_i386_)
 #define IWORDS_MUST_ALIGN 0
@@ -45,7 +67,10 @@
 namespace stone
 {
 
+    // times are ms, or us after set_clock_us() (scaled by 1000) unless
+    // they have a _US variant
     const uint32_t KCP_RTO_NDL = 30;  // no delay min rto
+    const uint32_t KCP_RTO_NDL_US = 1000; // no delay min rto in microseconds
     const uint32_t KCP_RTO_MIN = 100; // normal min rto
     const uint32_t KCP_RTO_DEF = 200;
     const uint32_t KCP_RTO_MAX = 60000;
@@ -53,13 +78,46 @@ namespace stone
     const uint32_t KCP_CMD_ACK = 82;  // cmd: ack
     const uint32_t KCP_CMD_WASK = 83; // cmd: window probe (ask)
     const uint32_t KCP_CMD_WINS = 84; // cmd: window size (tell)
+    const uint32_t KCP_CMD_OPTS = 85; // cmd: option negotiation
+    const uint32_t KCP_CMD_SKIP = 86; // cmd: expired data, skip over this sn
+    const uint32_t KCP_CMD_PUSHZ = 87; // cmd: push data of a compressed message
+    const uint32_t KCP_CMD_FILE = 0;   // send_queue placeholder for the rest of a file, never on the wire
     const uint32_t KCP_ASK_SEND = 1;  // need to send KCP_CMD_WASK
     const uint32_t KCP_ASK_TELL = 2;  // need to send KCP_CMD_WINS
+    const uint32_t KCP_ASK_OPTS = 4;  // need to send KCP_CMD_OPTS
+    const uint32_t KCP_OPT_WSCALE = 1;   // option: window scale
+    const uint32_t KCP_OPT_COMPACT = 2;  // option: compact headers
+    const uint32_t KCP_OPT_COMPRESS = 4; // option: compressed messages
+    const uint32_t KCP_OPT_ANSWER = 0x40; // own options not echoed yet, answer with KCP_OPT_ECHO
+    const uint32_t KCP_OPT_ECHO = 0x80;  // remote options have been received
+    const uint32_t KCP_OPTS_LEN = 2;     // option payload: flags, wscale
+    const uint32_t KCP_WSCALE_MAX = 14;
+    const uint32_t KCP_CMD_COMPACT = 0x80;  // cmd flag: compact headers follow in the datagram
+    const uint32_t KCP_COMPACT_CMD = 0x07;  // compact flags: cmd - KCP_CMD_PUSH + 1
+    const uint32_t KCP_COMPACT_FRG = 0x08;  // compact flags: frg present, else 0
+    const uint32_t KCP_COMPACT_WND = 0x10;  // compact flags: wnd present, else as previous
+    const uint32_t KCP_COMPACT_TS = 0x20;   // compact flags: ts delta present, else as previous
+    const uint32_t KCP_COMPACT_UNA = 0x40;  // compact flags: una delta present, else as previous
+    const uint32_t KCP_COMPACT_LEN = 0x80;  // compact flags: len present, else 0
     const uint32_t KCP_WND_SND = 32;
     const uint32_t KCP_WND_RCV = 128; // must >= max fragment size
+    const uint32_t KCP_FRG_MAX = 256; // frg is 8 bits on the wire
+    const uint32_t KCP_TUNE_EPOCH = 100; // rcv_wnd tuning period without an rtt sample
+    const uint32_t KCP_IDLE_COMPACT = 5000; // ms without output before flush() compacts the session
+    const uint32_t KCP_STREAM_HEAD = 6; // multistream: stream id (16) + stream sn (32) before data
+    const uint32_t KCP_ZHEAD = 4;              // compressed message: size before compression
+    const uint32_t KCP_COMPRESS_MIN = 64;      // smaller messages are sent raw
+    const uint32_t KCP_COMPRESS_BACKOFF = 6;   // skip up to 2^6-1 messages after incompressible ones
+    const uint32_t KCP_FILE_FRAGMENTS = 64;    // send_file: fragments per message, one mapping each
+    const uint32_t KCP_SEAL_SALT = HCHACHA_NONCE_LEN; // random per session, the first part of the nonce
+    const uint32_t KCP_SEAL_OVERHEAD = 40;     // sealed datagram: salt (16) + nonce counter (8) + tag (16) after the segments
+    const uint32_t KCP_CRC_LEN = 4;            // datagram checksum: crc32c of everything before it
     const uint32_t KCP_MTU_DEF = 1400;
     const uint32_t KCP_ACK_FAST = 3;
     const uint32_t KCP_INTERVAL = 100;
+    const uint32_t KCP_INTERVAL_MIN = 10;     // lower clamp of the flush interval
+    const uint32_t KCP_INTERVAL_MIN_US = 100; // in microseconds
+    const uint32_t KCP_INTERVAL_MAX = 5000;
     const uint32_t KCP_OVERHEAD = 24;
     const uint32_t KCP_DEADLINK = 20;
     const uint32_t KCP_THRESH_INIT = 2;
@@ -86,6 +144,7 @@ namespace stone
     public:
         KcpMsg();
         KcpMsg(int size);
+        KcpMsg(const std::shared_ptr<const char> &ref, int offset); // data inside a caller buffer
         KcpMsg(const KcpMsg &msg)=delete;
         KcpMsg &operator=(const KcpMsg &msg)=delete;
         KcpMsg(KcpMsg &&msg)=delete;
@@ -93,12 +152,14 @@ namespace stone
         ~KcpMsg();
 
         void parse_header(const char *data);
+        int parse_compact_header(const char *data, uint32_t size, const kcpHeader &prev);
         kcpHeader &header();
         char *data();
 
     private: 
         kcpHeader header_;
         char *data_;
+        std::shared_ptr<const char> ref_; // keeps the caller buffer of data_, if any
     };
    
 
@@ -107,6 +168,7 @@ namespace stone
     public:
         kcpSeg();
         kcpSeg(int size);
+        kcpSeg(const std::shared_ptr<const char> &ref, int offset);
         kcpSeg(const kcpSeg &seg)=delete;
         kcpSeg &operator=(const kcpSeg &seg)=delete;
         kcpSeg(kcpSeg &&seg)=delete;
@@ -114,52 +176,451 @@ namespace stone
         ~kcpSeg();
 
         void parse_header(const char *data);
+        int parse_compact_header(const char *data, uint32_t size, const kcpHeader &prev);
 
         char *copy_header2buf(char *buf);
+        char *copy_compact_header2buf(char *buf, const kcpHeader &prev);
 
         char *copy_data2buf(char *buf);
         int size();
         void set_data(const char *buf, int len);
 
-        uint32_t resendts; // resend timestamp
+        uint64_t resendts; // resend timestamp
         uint32_t rto;      // retransmission timeout
         uint32_t fastack;  // fast retransmit
         uint32_t xmit;     // transmit times
+        uint32_t ts_resent; // wire ts of the first retransmission, see check_spurious()
+        uint64_t expire;   // drop instead of resend after this, 0 for reliable
         KcpMsg msg_;
     };
 
 
 
-    class Kcpp;
-    using outputCallBack = std::function<int(const char *buf, int len, Kcpp *kcp, void *user)>;
+    // counted in the hot paths unless KCP_STATS is 0, data segments only
+    struct KcpCounters
+    {
+        uint64_t segs_sent = 0, bytes_sent = 0;         // output, resends included
+        uint64_t segs_retrans = 0, bytes_retrans = 0;   // resent, for any reason
+        uint64_t rto_expired = 0;                       // resent after rto
+        uint64_t fast_retrans = 0;                      // resent after fastresend acks skipped them
+        uint64_t segs_received = 0, bytes_received = 0; // input in window, duplicates included
+        uint64_t dup_dropped = 0;                       // received before, dropped
+        uint64_t corrupt_dropped = 0;                   // compressed messages which did not decompress
+        uint64_t file_short = 0;                        // send_file() bytes not sent, the file shrank or failed
+        uint64_t acks_received = 0;
+        uint64_t datagrams_sent = 0, datagrams_received = 0; // accepted by the checksum and the cipher
+    };
+
+    // snapshot of stats(): the counters, and the current state
+    struct KcpStats : KcpCounters
+    {
+        int32_t srtt = 0, rttvar = 0, rto = 0; // session clock units
+        uint32_t cwnd = 0, ssthresh = 0;
+        uint32_t snd_wnd = 0, rcv_wnd = 0, rmt_wnd = 0; // segments
+        uint32_t nsnd_buf = 0, nsnd_queue = 0, nrcv_queue = 0;
+    };
+
+    // receive window memory granted by auto-tuning, shared by the sessions
+    // of the process
+    struct KcpRcvMemory
+    {
+        static inline std::atomic<uint64_t> used{0};
+        static inline std::atomic<uint64_t> limit{0}; // 0 for no limit
+    };
+
+    // runtime configuration, changed by set_mtu(), set_wndsize(), no_delay()
+    // and set_stream()
+    struct KcpRuntimeConfig
+    {
+        static constexpr bool fixed = false;
+        uint32_t mtu = KCP_MTU_DEF;
+        uint32_t snd_wnd = KCP_WND_SND;
+        uint32_t rcv_wnd = KCP_WND_RCV;
+        int32_t nodelay = 0;
+        bool nocwnd = false;
+        bool stream = false;
+    };
+
+    // compile time configuration: the branches on these values fold away and
+    // the datagram buffer and the windows are sized statically. The setters
+    // leave them unchanged.
+    template <uint32_t Mtu, uint32_t SndWnd, uint32_t RcvWnd, int32_t NoDelay, bool NoCwnd, bool Stream>
+    struct KcpStaticConfig
+    {
+        static_assert(Mtu >= 50 && Mtu > KCP_OVERHEAD, "mtu too small");
+        static_assert(SndWnd > 0 && RcvWnd >= KCP_WND_RCV, "window too small");
+
+        static constexpr bool fixed = true;
+        static constexpr uint32_t mtu = Mtu;
+        static constexpr uint32_t snd_wnd = SndWnd;
+        static constexpr uint32_t rcv_wnd = RcvWnd;
+        static constexpr int32_t nodelay = NoDelay;
+        static constexpr bool nocwnd = NoCwnd;
+        static constexpr bool stream = Stream;
+    };
+
+    // iterator of the rings below, by index from the front
+    template <typename R, typename V>
+    class KcpRingIterator
+    {
+    public:
+        KcpRingIterator(R *ring, uint32_t index) : ring_(ring), index_(index) {}
+        V &operator*() const { return (*ring_)[index_]; }
+        KcpRingIterator &operator++()
+        {
+            index_++;
+            return *this;
+        }
+        bool operator!=(const KcpRingIterator &other) const { return index_ != other.index_; }
+
+    private:
+        R *ring_;
+        uint32_t index_;
+    };
+
+    // fixed capacity ring with the part of the deque interface the windows use
+    template <typename T, uint32_t Capacity>
+    class KcpRing
+    {
+        static constexpr uint32_t pow2(uint32_t n, uint32_t p = 1)
+        {
+            return p >= n ? p : pow2(n, p * 2);
+        }
+        static constexpr uint32_t SIZE = pow2(Capacity);
+        static constexpr uint32_t MASK = SIZE - 1;
+
+    public:
+        using iterator = KcpRingIterator<KcpRing, T>;
+        using const_iterator = KcpRingIterator<const KcpRing, const T>;
+
+        T &operator[](size_t index) { return items_[(head_ + index) & MASK]; }
+        const T &operator[](size_t index) const { return items_[(head_ + index) & MASK]; }
+        T &front() { return items_[head_]; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        void push_back(T &&item)
+        {
+            assert(size_ < SIZE);
+            items_[(head_ + size_++) & MASK] = std::move(item);
+        }
+
+        void pop_front()
+        {
+            items_[head_] = T();
+            head_ = (head_ + 1) & MASK;
+            size_--;
+        }
+
+        void resize(size_t size)
+        {
+            assert(size <= SIZE);
+            for (; size_ > size; size_--)
+            {
+                items_[(head_ + size_ - 1) & MASK] = T();
+            }
+            size_ = static_cast<uint32_t>(size);
+        }
+
+        void shrink_to_fit() {}
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end() { return iterator(this, size_); }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size_); }
+
+    private:
+        std::array<T, SIZE> items_;
+        uint32_t head_ = 0, size_ = 0;
+    };
+
+    // the same ring growing by doubling, it has no storage until the first
+    // push, and gives it back on shrink_to_fit() once empty. Slots outside
+    // the items are kept default constructed.
+    template <typename T>
+    class KcpDynRing
+    {
+    public:
+        using iterator = KcpRingIterator<KcpDynRing, T>;
+        using const_iterator = KcpRingIterator<const KcpDynRing, const T>;
+
+        T &operator[](size_t index) { return items_[(head_ + index) & (capacity_ - 1)]; }
+        const T &operator[](size_t index) const { return items_[(head_ + index) & (capacity_ - 1)]; }
+        T &front() { return items_[head_]; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+
+        void push_back(T &&item)
+        {
+            if (size_ == capacity_)
+            {
+                grow(size_ + 1);
+            }
+            items_[(head_ + size_++) & (capacity_ - 1)] = std::move(item);
+        }
+
+        void pop_front()
+        {
+            items_[head_] = T();
+            head_ = (head_ + 1) & (capacity_ - 1);
+            size_--;
+        }
+
+        void resize(size_t size)
+        {
+            if (size > capacity_)
+            {
+                grow(static_cast<uint32_t>(size));
+            }
+            for (; size_ > size; size_--)
+            {
+                items_[(head_ + size_ - 1) & (capacity_ - 1)] = T();
+            }
+            size_ = static_cast<uint32_t>(size);
+        }
+
+        void shrink_to_fit()
+        {
+            if (size_ == 0)
+            {
+                items_.reset();
+                head_ = capacity_ = 0;
+            }
+        }
+
+        iterator begin() { return iterator(this, 0); }
+        iterator end() { return iterator(this, size_); }
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, size_); }
+
+    private:
+        void grow(uint32_t size)
+        {
+            uint32_t capacity = capacity_ > 0 ? capacity_ : 8;
+            while (capacity < size)
+            {
+                capacity *= 2;
+            }
+            std::unique_ptr<T[]> items(new T[capacity]);
+            for (uint32_t i = 0; i < size_; i++)
+            {
+                items[i] = std::move((*this)[i]);
+            }
+            items_ = std::move(items);
+            head_ = 0;
+            capacity_ = capacity;
+        }
+
+        std::unique_ptr<T[]> items_;
+        uint32_t head_ = 0, size_ = 0, capacity_ = 0;
+    };
+
+    // window indexed by sn: a growable ring, or one of the window size when fixed
+    template <typename Config, typename T, bool Send, bool Fixed = Config::fixed>
+    struct KcpWindow
+    {
+        using type = KcpDynRing<T>;
+    };
+
+    template <typename Config, typename T, bool Send>
+    struct KcpWindow<Config, T, Send, true>
+    {
+        using type = KcpRing<T, Send ? Config::snd_wnd : Config::rcv_wnd>;
+    };
+
+    // datagram buffer, inline when the mtu is fixed
+    template <typename Config, bool Fixed = Config::fixed>
+    class KcpBuffer
+    {
+    public:
+        char *data() { return data_.get(); }
+        void resize(uint32_t mtu) { data_.reset(new char[(mtu + KCP_OVERHEAD) * 3]); }
+        void release() { data_.reset(); }
+
+    private:
+        std::unique_ptr<char[]> data_;
+    };
 
-    class Kcpp
+    template <typename Config>
+    class KcpBuffer<Config, true>
     {
     public:
+        char *data() { return data_; }
+        void resize(uint32_t) {}
+        void release() {}
+
+    private:
+        char data_[(Config::mtu + KCP_OVERHEAD) * 3];
+    };
+
+    template <typename Config>
+    class BasicKcpp
+    {
+    public:
+        using outputCallBack = std::function<int(const char *buf, int len, BasicKcpp *kcp, void *user)>;
+        using notifyCallBack = std::function<void(BasicKcpp *kcp, void *user)>;
         using kcpSegPtr = std::unique_ptr<kcpSeg>;
         using kcpSegList = std::list<kcpSegPtr>;
+        using kcpSegWnd = typename KcpWindow<Config, kcpSegPtr, true>::type; // indexed by sn, nullptr for holes
+
+        struct RcvSlot
+        {
+            kcpSegPtr seg;
+            bool got = false; // stays set when seg has been routed to a stream
+        };
+        using RcvWnd = typename KcpWindow<Config, RcvSlot, false>::type;
+
+        // one ordered stream in multistream mode
+        struct Stream
+        {
+            uint32_t snd_nxt = 0; // next stream sn to send
+            uint32_t rcv_nxt = 0; // next stream sn to deliver
+            std::map<uint32_t, kcpSegPtr> rcv_buf; // out of order, by stream sn
+            kcpSegList rcv_queue;
+            bool rcv_drop = false; // dropping the rest of a skipped message
+        };
         using AckList = std::vector<std::array<uint32_t, 2>>;
-        Kcpp(uint32_t conv, void *user);
-        ~Kcpp();
 
-        Kcpp(const Kcpp &) = delete;
-        Kcpp &operator=(const Kcpp &) = delete;
-        Kcpp(Kcpp &&) = delete;
-        Kcpp &operator=(Kcpp &&) = delete;
+        // file region given to send_file(), not yet in send_queue
+        struct FileSend
+        {
+            int fd;
+            uint64_t offset, len;
+            uint16_t stream;
+            bool regular; // mapped, or read with pread(), otherwise read()
+        };
+        BasicKcpp(uint32_t conv, void *user);
+        ~BasicKcpp();
+
+        BasicKcpp(const BasicKcpp &) = delete;
+        BasicKcpp &operator=(const BasicKcpp &) = delete;
+        BasicKcpp(BasicKcpp &&) = delete;
+        BasicKcpp &operator=(BasicKcpp &&) = delete;
 
     public:
-        int send(const char *data, int len);
-        int recv(char *buffer, int len);
+        // lifetime: ms (us, see set_clock_us()) after which unacked data is
+        // skipped instead of resent, 0 for reliable. -2 for a message of more
+        // fragments than the remote's window, KCP_WND_RCV until it has
+        // advertised a larger one.
+        int send(const char *data, int len, uint16_t stream = 0, uint32_t lifetime = 0);
+        // send without copying: the segments point into data, which is
+        // released (by the deleter) once every fragment is acknowledged or
+        // dropped. Copied as usual in multistream or streaming mode, and
+        // when the message may be compressed.
+        int send(std::shared_ptr<const char> data, int len, uint16_t stream = 0, uint32_t lifetime = 0);
+        int send(std::vector<char> &&data, uint16_t stream = 0, uint32_t lifetime = 0);
+        // send len bytes of a file from offset, after what is already queued.
+        // The file is mapped a message of KCP_FILE_FRAGMENTS segments at a
+        // time, when the window admits it, and each mapping is released once
+        // acknowledged, so memory is bounded by the window. The receiver gets
+        // messages of up to KCP_FILE_FRAGMENTS * mss bytes. A pipe or socket
+        // is read() as the window admits, it must block and offset must be 0.
+        // fd is duplicated. Returns -1 if the range is past the end of the
+        // file, for a non-blocking pipe, if dup() fails or on platforms
+        // without mmap. The file must not shrink until all of it is
+        // acknowledged: a retransmission reads the mapped pages, and one
+        // past the new end raises SIGBUS. Should a pipe end early, the rest
+        // is not sent and counted in stats().file_short.
+        int send_file(int fd, uint64_t offset, uint64_t len, uint16_t stream = 0);
+        // -4 for a compressed message which does not decompress, it is
+        // dropped and the next recv() goes on with the following one
+        int recv(char *buffer, int len, uint16_t stream = 0);
         int input(const char *data, uint32_t size);
+        // current is the low 32 bits of the session clock, extended to 64
+        // bits internally so it may wrap
         void update(uint32_t current);
         int32_t check(uint32_t current);
+        // the same with the whole 64 bit clock, check64() returns it too
+        void update64(uint64_t current);
+        uint64_t check64(uint64_t current);
+        // count time in microseconds instead of ms: update() and check(),
+        // set_interval(), no_delay(), set_minrto(), send() lifetimes and the
+        // rtt in stats() all take or give us, and the interval may go down to
+        // KCP_INTERVAL_MIN_US and the no delay min rto is KCP_RTO_NDL_US.
+        // The current settings are converted. Only before the first update(),
+        // else it returns false. ts on the wire is the low 32 bits, which the
+        // remote only echoes, so the two sides need not agree.
+        bool set_clock_us(bool us);
         void flush();
-        int peek_size();
+        int peek_size(uint16_t stream = 0);
 
         int wait_send_size();
+        KcpStats stats() const;
+        // all zero unless built with KCP_PROFILE
+        KcpProfile profile() const;
+
+        // keep the last capacity protocol events in a ring, 0 to stop
+        void set_trace(uint32_t capacity);
+        const KcpTrace *trace() const
+        {
+            return trace_.get();
+        }
+
+        // give back the scratch memory of an idle session: the datagram
+        // buffer, the window storage and the ack list. Nothing may be queued,
+        // in flight, unread or unacknowledged, else it returns false. They
+        // are allocated again on the next send() or input(). flush() does it
+        // after KCP_IDLE_COMPACT ms without output.
+        bool compact();
+
+        // segment payload bytes waiting in send_queue (unsent files
+        // included), sent and not acknowledged yet, and received in order
+        // but not read by recv() yet
+        uint64_t queued_bytes() const { return snd_queued_bytes_; }
+        uint64_t inflight_bytes() const { return snd_flight_bytes_; }
+        uint64_t buffered_bytes() const { return rcv_bytes_; }
+
+        // once queued + in flight bytes reach high, writable() is false until
+        // they fall back to low, then the callback is called from input() or
+        // flush(). high 0 turns it off.
+        void set_send_watermark(uint64_t low, uint64_t high, const notifyCallBack &writable);
+        bool writable() const { return !snd_blocked_; }
+        // the callback is called after input() has buffered new data, if at
+        // least low bytes are buffered
+        void set_recv_watermark(uint64_t low, const notifyCallBack &readable);
         void no_delay(int nodelay, int interval, int resend, bool nocwnd);
 
         void set_wndsize(int sndwnd, int rcvwnd);
+        // grow rcv_wnd past the set_wndsize() value while the remote is
+        // window limited and recv() keeps up, shrink it back when data piles
+        // up. The window stays below max_bytes of segments, and grows only
+        // into what set_rcv_memory_limit() leaves. 0 turns it off. Not
+        // available with a fixed configuration.
+        void set_rcv_autotune(uint64_t max_bytes);
+        static void set_rcv_memory_limit(uint64_t bytes)
+        {
+            KcpRcvMemory::limit = bytes;
+        }
+        bool set_wndscale(int wscale);
+
+        // offer per message compression to the remote
+        void set_compress(bool compress)
+        {
+            set_option(KCP_OPT_COMPRESS, compress);
+        }
+
+        // offer delta encoded headers to the remote, for small segments
+        void set_compact(bool compact)
+        {
+            set_option(KCP_OPT_COMPACT, compact);
+        }
+
+        // KCP_OPT_* flags in effect, offered by both sides
+        uint8_t options() const
+        {
+            return opt_;
+        }
+        // seal every datagram with XChaCha20-Poly1305, one key per direction
+        // (the remote passes them swapped), nullptr to send in clear. Both
+        // sides must agree on it before any data is sent. Each call draws a
+        // random salt, sent with every datagram, and seals under a key
+        // derived from it, so sessions may share keys without ever reusing
+        // a nonce. Returns false if the mtu has no room for the trailer.
+        bool set_cipher(const uint8_t *tx_key, const uint8_t *rx_key);
+
+        // append a crc32c to every datagram and drop those that do not
+        // match, both sides must agree on it before any data is sent
+        bool set_checksum(bool checksum);
         void set_output(const outputCallBack &func);
         void set_interval(int interval);
         bool set_mtu(int mtu);
@@ -170,7 +631,17 @@ namespace stone
 
         void set_stream(bool stream)
         {
-            stream_ = stream;
+            if constexpr (!Config::fixed)
+            {
+                cfg_.stream = stream;
+            }
+        }
+
+        // independently ordered streams inside the conversation, both sides
+        // must agree on it before any data is sent
+        void set_multistream(bool multistream)
+        {
+            multistream_ = multistream;
         }
 
         void set_fastresend(int fastresend)
@@ -178,11 +649,26 @@ namespace stone
             fastresend_ = fastresend;
         }
 
+        // undo cwnd reduction when a retransmission turns out to be spurious
+        void set_undo(bool undo)
+        {
+            undo_ = undo;
+            undo_pending_ = false;
+        }
+
 
     private:
         void parse_fastack(uint32_t sn, uint32_t ts);
+        int send_fragments(const char *data, int len, uint8_t cmd, uint16_t stream, uint64_t expire,
+                           const std::shared_ptr<const char> &ref, kcpSegList &queue);
+        bool load_file();
+
+        uint32_t clamp_interval(int interval) const;
+        uint64_t extend_clock(uint32_t current) const;
 
         void update_ack(int rtt);
+        void check_spurious(uint32_t sn, uint32_t ts);
+        void undo_spurious(uint32_t ts);
         void update_probe();
 
         void check_data_repeat(kcpSegPtr newseg);
@@ -190,41 +676,112 @@ namespace stone
         void remove_before_una(uint32_t una);
 
         int wnd_unused();
+        uint16_t wnd_adv();
+        void set_option(uint8_t option, bool enable);
+        void parse_opts(const char *data, uint32_t len);
+        void update_opts();
+        bool set_tail(bool sealed, bool checksum);
         void shrink_buf();
         void mv_buf_to_queue();
+        void tune_rcv_wnd();
+        void reset_rcv_wnd();
         void mv_queue_to_buf();
+        void route_stream(kcpSegPtr seg);
+        int deliver(kcpSegList &queue, bool &drop, kcpSegPtr seg);
+        void drop_expired();
+        void expire_seg(kcpSeg &seg);
+        uint32_t rcv_queued();
+        void queue_bytes(uint64_t bytes);
+        void notify(uint64_t buffered);
+        void trace_cwnd();
 
         
 
-        int output(const char *data, int size);
+        int output(char *data, int size);
 
-        void flush_ack();
-        void flush_window_probe();
-        void flush_data();
+        char *flush_ack(char *ptr);
+        char *flush_window_probe(char *ptr);
+        char *flush_data(char *ptr);
 
-        char *try_output(char *ptr);
+        char *datagram_buffer();
+        char *try_output(char *ptr, int need);
+        char *encode_header(char *ptr, kcpSeg &seg);
 
     private:
-        uint32_t conv_, mtu_, mss_;
+        Config cfg_;
+        uint32_t conv_, mss_;
         uint32_t snd_una_, snd_nxt_, rcv_nxt_;
         uint32_t ts_recent_, ts_lastack_, ssthresh_;
         int32_t rx_rttval_, rx_srtt_, rx_rto_, rx_minrto_;
-        uint32_t snd_wnd_, rcv_wnd_, rmt_wnd_, cwnd_, probe_;
-        uint32_t current_, interval_, ts_flush_, xmit_;
-        uint32_t ts_probe_, probe_wait_;
+        uint32_t rmt_wnd_, cwnd_, probe_;
+        // largest window advertised by the remote, and by us, up to
+        // KCP_FRG_MAX: a message of that many fragments can be reassembled
+        uint32_t rmt_wnd_peak_, wnd_adv_peak_;
+        uint64_t current_, ts_flush_; // session clock, see set_clock_us()
+        uint32_t interval_, xmit_, unit_; // unit_: clock ticks per ms
+        uint64_t ts_probe_;
+        uint32_t probe_wait_;
         uint32_t dead_link_, incr_;
-        int32_t nodelay_,fastresend_,fastlimit_;
-        kcpSegList send_buf_;
-        kcpSegList rcv_buf_;
+        int32_t fastresend_,fastlimit_;
+        uint32_t undo_cwnd_, undo_ssthresh_, undo_incr_;
+        uint32_t undo_recover_; // snd_nxt at the snapshot, the episode ends once una passes it
+        uint32_t nsnd_buf_;
+        uint32_t wscale_, rmt_wscale_;
+        uint64_t ts_opts_;
+        uint8_t opt_local_, opt_remote_, opt_;
+        uint32_t nrcv_stream_;
+        uint32_t nsnd_expire_; // segments with a lifetime in send_queue
+        uint32_t zskip_, zfail_; // messages left to send raw, incompressible streak
+        uint32_t rcv_wnd_base_, rcv_tune_max_; // set_wndsize() window, tuning limit (0 off)
+        uint64_t ts_tune_;                     // tuning period start
+        uint32_t tune_nxt_;                    // rcv_nxt then
+        uint64_t ts_active_;                   // last output
+        uint64_t rcv_reserved_;                // taken from KcpRcvMemory
+        uint32_t tail_;          // bytes appended to each datagram after the segments
+        uint64_t seal_nxt_;      // nonce counter of the next sealed datagram
+        kcpSegWnd send_buf_;
+        RcvWnd rcv_buf_;
         kcpSegList send_queue_;
+        std::list<FileSend> files_; // one KCP_CMD_FILE placeholder each in send_queue
         kcpSegList rcv_queue_;
         AckList acklist_;
+        kcpHeader enc_prev_; // previous header written to the datagram
+        std::vector<char> zbuf_; // compressed message being sent or received
+        std::vector<char> rbuf_; // opened datagram being parsed
+        std::array<uint8_t, AEAD_KEY_LEN> tx_key_, rx_key_; // tx_key_ is derived from tx_salt_
+        std::array<uint8_t, AEAD_KEY_LEN> rx_subkey_;       // rx_key_ with rx_salt_, the remote salt
+        std::array<uint8_t, KCP_SEAL_SALT> tx_salt_, rx_salt_;
+        std::unordered_map<uint16_t, Stream> streams_;
+        KcpBuffer<Config> storage_;
         char *buffer_;
         void *user_;
         outputCallBack output_;
-        bool nocwnd_, stream_, updated_, state_;
+#if KCP_STATS
+        KcpCounters counters_;
+#endif
+#if KCP_PROFILE
+        KcpProfile profile_;
+#endif
+        std::unique_ptr<KcpTrace> trace_;
+        uint64_t snd_queued_bytes_, snd_flight_bytes_, rcv_bytes_;
+        uint64_t snd_lowat_, snd_hiwat_, rcv_lowat_;
+        notifyCallBack writable_, readable_;
+        bool updated_, state_, undo_, undo_pending_;
+        bool opt_recv_, opt_echoed_, multistream_, sealed_, checksum_;
+        bool snd_msg_open_, rcv_drop_, snd_blocked_, compacted_, rx_keyed_;
     };
 
+    using Kcpp = BasicKcpp<KcpRuntimeConfig>;
+    using outputCallBack = Kcpp::outputCallBack;
+
+    // fast mode fixed at compile time: no_delay(1, interval, resend, true),
+    // 128 segment windows and the default mtu
+    using KcppFast = BasicKcpp<KcpStaticConfig<KCP_MTU_DEF, 128, 128, 1, true, false>>;
+
+    // these two are compiled once in kcpp.cpp, include kcpp_impl.h to
+    // instantiate others
+    extern template class BasicKcpp<KcpRuntimeConfig>;
+    extern template class BasicKcpp<KcpStaticConfig<KCP_MTU_DEF, 128, 128, 1, true, false>>;
 }
 
 #endif
\ No newline at end of file
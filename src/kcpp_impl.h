@@ -0,0 +1,2215 @@
+#ifndef STONE_KCP_IMPL_H
+#define STONE_KCP_IMPL_H
+#include "kcpp.h"
+#include "lz.h"
+#include "wire.h"
+
+#include <limits>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <random>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KCP_HAS_MMAP 1
+#endif
+
+#if KCP_STATS
+#define KCP_COUNT(field, n) (counters_.field += (n))
+#else
+#define KCP_COUNT(field, n) ((void)0)
+#endif
+
+// time consecutive phases of one call: BEGIN starts the clock, each LAP
+// charges the ticks since the previous mark to a phase
+#if KCP_PROFILE
+#define KCP_PROFILE_BEGIN() uint64_t kcp_lap_ = kcp_ticks()
+#define KCP_PROFILE_LAP(phase)                               \
+    do                                                       \
+    {                                                        \
+        uint64_t kcp_now_ = kcp_ticks();                     \
+        profile_.phases[(phase)].record(kcp_now_ - kcp_lap_); \
+        kcp_lap_ = kcp_now_;                                 \
+    } while (0)
+#else
+#define KCP_PROFILE_BEGIN() ((void)0)
+#define KCP_PROFILE_LAP(phase) ((void)0)
+#endif
+
+#define KCP_TRACE(type, sn, value)                          \
+    do                                                      \
+    {                                                       \
+        if (trace_)                                         \
+            trace_->record((type), static_cast<uint32_t>(current_), (sn), (value)); \
+    } while (0)
+
+namespace stone
+{
+    // sequence numbers and wire timestamps wrap, the difference is taken
+    // modulo 2^32
+    static inline int32_t _itimediff(uint32_t later, uint32_t earlier)
+    {
+        return static_cast<int32_t>(later - earlier);
+    }
+    // the 64 bit session clock does not wrap
+    static inline int64_t _itimediff(uint64_t later, uint64_t earlier)
+    {
+        return static_cast<int64_t>(later - earlier);
+    }
+
+    // stream header in front of the data in multistream mode: id, sn
+    static inline uint16_t _stream_id(const char *data)
+    {
+        return wire_load16(data);
+    }
+
+    static inline uint32_t _stream_sn(const char *data)
+    {
+        return wire_load32(data + sizeof(uint16_t));
+    }
+
+    // varint and zigzag coding for compact headers
+    static inline char *_encode_varint(char *ptr, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            *ptr++ = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        *ptr++ = static_cast<char>(value);
+        return ptr;
+    }
+
+    static inline bool _decode_varint(const char *&ptr, const char *end, uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35 && ptr < end; shift += 7)
+        {
+            uint8_t byte = static_cast<uint8_t>(*ptr++);
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static inline uint32_t _zigzag(uint32_t delta)
+    {
+        return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+    }
+
+    static inline uint32_t _unzigzag(uint32_t value)
+    {
+        return (value >> 1) ^ (0u - (value & 1));
+    }
+
+    template <typename Config>
+    BasicKcpp<Config>::BasicKcpp(uint32_t conv, void *user)
+        : conv_(conv), mss_(cfg_.mtu - KCP_OVERHEAD),
+          snd_una_(0), snd_nxt_(0), rcv_nxt_(0), ts_recent_(0), ts_lastack_(0), ssthresh_(KCP_THRESH_INIT),
+          rx_rttval_(0), rx_srtt_(0), rx_rto_(KCP_RTO_DEF), rx_minrto_(KCP_RTO_MIN),
+          rmt_wnd_(KCP_WND_RCV), cwnd_(0), probe_(0), rmt_wnd_peak_(0), wnd_adv_peak_(0),
+          current_(0), ts_flush_(KCP_INTERVAL), interval_(KCP_INTERVAL), xmit_(0), unit_(1),
+          ts_probe_(0), probe_wait_(0), dead_link_(KCP_DEADLINK), incr_(0),
+          fastresend_(0), fastlimit_(KCP_FASTACK_LIMIT),
+          undo_cwnd_(0), undo_ssthresh_(0), undo_incr_(0), undo_recover_(0), nsnd_buf_(0),
+          wscale_(0), rmt_wscale_(0), ts_opts_(0), opt_local_(0), opt_remote_(0), opt_(0), nrcv_stream_(0),
+          nsnd_expire_(0), zskip_(0), zfail_(0),
+          rcv_wnd_base_(cfg_.rcv_wnd), rcv_tune_max_(0), ts_tune_(0), tune_nxt_(0), ts_active_(0), rcv_reserved_(0),
+          tail_(0), seal_nxt_(0),
+          buffer_(nullptr), user_(user), output_(nullptr),
+          snd_queued_bytes_(0), snd_flight_bytes_(0), rcv_bytes_(0), snd_lowat_(0), snd_hiwat_(0), rcv_lowat_(1),
+          updated_(false), state_(false), undo_(true), undo_pending_(false),
+          opt_recv_(false), opt_echoed_(false), multistream_(false), sealed_(false), checksum_(false), snd_msg_open_(false), rcv_drop_(false),
+          snd_blocked_(false), compacted_(false), rx_keyed_(false)
+    {
+        buffer_ = storage_.data(); // allocated by the first output, unless fixed
+        rx_minrto_ = cfg_.nodelay != 0 ? KCP_RTO_NDL : KCP_RTO_MIN;
+        memset(&enc_prev_, 0, sizeof(enc_prev_));
+    }
+
+    template <typename Config>
+    BasicKcpp<Config>::~BasicKcpp()
+    {
+        reset_rcv_wnd();
+#ifdef KCP_HAS_MMAP
+        for (auto &file : files_)
+        {
+            close(file.fd);
+        }
+#endif
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_output(const outputCallBack &func)
+    {
+        output_ = func;
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_send_watermark(uint64_t low, uint64_t high, const notifyCallBack &writable)
+    {
+        snd_lowat_ = std::min(low, high);
+        snd_hiwat_ = high;
+        writable_ = writable;
+        snd_blocked_ = false;
+        queue_bytes(0);
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_recv_watermark(uint64_t low, const notifyCallBack &readable)
+    {
+        rcv_lowat_ = std::max<uint64_t>(low, 1);
+        readable_ = readable;
+    }
+
+    // account bytes entering send_queue, blocks the sender at the high watermark
+    template <typename Config>
+    void BasicKcpp<Config>::queue_bytes(uint64_t bytes)
+    {
+        snd_queued_bytes_ += bytes;
+        if (snd_hiwat_ > 0 && snd_queued_bytes_ + snd_flight_bytes_ >= snd_hiwat_)
+        {
+            snd_blocked_ = true;
+        }
+    }
+
+    // run the callbacks once the state is consistent, buffered is
+    // rcv_bytes_ before the input
+    template <typename Config>
+    void BasicKcpp<Config>::notify(uint64_t buffered)
+    {
+        if (snd_blocked_ && snd_queued_bytes_ + snd_flight_bytes_ <= snd_lowat_)
+        {
+            snd_blocked_ = false;
+            if (writable_)
+            {
+                writable_(this, user_);
+            }
+        }
+        if (readable_ && rcv_bytes_ > buffered && rcv_bytes_ >= rcv_lowat_)
+        {
+            readable_(this, user_);
+        }
+    }
+
+    template <typename Config>
+    bool BasicKcpp<Config>::set_mtu(int mtu)
+    {
+        if constexpr (Config::fixed)
+        {
+            return mtu == static_cast<int>(cfg_.mtu);
+        }
+        else
+        {
+            if (mtu < 50 || mtu < static_cast<int>(KCP_OVERHEAD + tail_) + 1)
+            {
+                return false;
+            }
+            storage_.release();
+            buffer_ = storage_.data();
+            cfg_.mtu = mtu;
+            mss_ = cfg_.mtu - KCP_OVERHEAD - tail_;
+            return true;
+        }
+    }
+
+    template <typename Config>
+    bool BasicKcpp<Config>::set_cipher(const uint8_t *tx_key, const uint8_t *rx_key)
+    {
+        bool sealed = tx_key != nullptr && rx_key != nullptr;
+        if (!set_tail(sealed, checksum_))
+        {
+            return false;
+        }
+        if (sealed)
+        {
+            std::random_device random;
+            for (uint32_t i = 0; i < KCP_SEAL_SALT; i += 4)
+            {
+                wire_store32(reinterpret_cast<char *>(tx_salt_.data() + i), random());
+            }
+            hchacha20(tx_key, tx_salt_.data(), tx_key_.data());
+            memcpy(rx_key_.data(), rx_key, AEAD_KEY_LEN);
+            rx_keyed_ = false;
+            seal_nxt_ = 0;
+        }
+        return true;
+    }
+
+    template <typename Config>
+    bool BasicKcpp<Config>::set_checksum(bool checksum)
+    {
+        return set_tail(sealed_, checksum);
+    }
+
+    // bytes after the segments of each datagram come out of the mss
+    template <typename Config>
+    bool BasicKcpp<Config>::set_tail(bool sealed, bool checksum)
+    {
+        uint32_t tail = (sealed ? KCP_SEAL_OVERHEAD : 0) + (checksum ? KCP_CRC_LEN : 0);
+        if (cfg_.mtu < KCP_OVERHEAD + tail + 1)
+        {
+            return false;
+        }
+        sealed_ = sealed;
+        checksum_ = checksum;
+        tail_ = tail;
+        mss_ = cfg_.mtu - KCP_OVERHEAD - tail_;
+        return true;
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_interval(int interval)
+    {
+        interval_ = clamp_interval(interval);
+    }
+
+    template <typename Config>
+    uint32_t BasicKcpp<Config>::clamp_interval(int interval) const
+    {
+        int lowest = static_cast<int>(unit_ == 1 ? KCP_INTERVAL_MIN : KCP_INTERVAL_MIN_US);
+        int highest = static_cast<int>(KCP_INTERVAL_MAX * unit_);
+        return static_cast<uint32_t>(std::min(std::max(interval, lowest), highest));
+    }
+
+    template <typename Config>
+    bool BasicKcpp<Config>::set_clock_us(bool us)
+    {
+        if (updated_)
+        {
+            return false;
+        }
+        uint32_t unit = us ? 1000 : 1;
+        if (unit != unit_)
+        {
+            // what was set so far is in the old unit
+            interval_ = static_cast<uint32_t>(static_cast<uint64_t>(interval_) * unit / unit_);
+            ts_flush_ = ts_flush_ * unit / unit_;
+            rx_rto_ = static_cast<int32_t>(static_cast<int64_t>(rx_rto_) * unit / unit_);
+            rx_minrto_ = static_cast<int32_t>(static_cast<int64_t>(rx_minrto_) * unit / unit_);
+            unit_ = unit;
+        }
+        return true;
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::no_delay(int nodelay, int interval, int resend, bool nocwnd)
+    {
+        if constexpr (!Config::fixed)
+        {
+            if (nodelay >= 0)
+            {
+                cfg_.nodelay = nodelay;
+            }
+            cfg_.nocwnd = nocwnd;
+        }
+        if (nodelay >= 0)
+        {
+            if (cfg_.nodelay != 0)
+            {
+                rx_minrto_ = unit_ == 1 ? KCP_RTO_NDL : KCP_RTO_NDL_US;
+            }
+            else
+            {
+                rx_minrto_ = KCP_RTO_MIN * unit_;
+            }
+        }
+
+        if (interval >= 0)
+        {
+            interval_ = clamp_interval(interval);
+        }
+        if (resend >= 0)
+        {
+            fastresend_ = resend;
+        }
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_wndsize(int sndwnd, int rcvwnd)
+    {
+        if constexpr (!Config::fixed)
+        {
+            if (sndwnd > 0)
+            {
+                cfg_.snd_wnd = sndwnd;
+            }
+
+            if (rcvwnd > 0)
+            {
+                reset_rcv_wnd();
+                // not below a window advertised already, a message that
+                // long may be under way
+                cfg_.rcv_wnd = std::max({KCP_WND_RCV, static_cast<uint32_t>(rcvwnd), wnd_adv_peak_});
+                rcv_wnd_base_ = cfg_.rcv_wnd;
+            }
+        }
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_rcv_autotune(uint64_t max_bytes)
+    {
+        if constexpr (!Config::fixed)
+        {
+            reset_rcv_wnd();
+            rcv_tune_max_ = static_cast<uint32_t>(std::min<uint64_t>(max_bytes / mss_, 0xffffffffu));
+            ts_tune_ = current_;
+            tune_nxt_ = rcv_nxt_;
+        }
+    }
+
+    // back to the set_wndsize() window, the memory is returned
+    template <typename Config>
+    void BasicKcpp<Config>::reset_rcv_wnd()
+    {
+        if constexpr (!Config::fixed)
+        {
+            KcpRcvMemory::used -= rcv_reserved_;
+            rcv_reserved_ = 0;
+            cfg_.rcv_wnd = rcv_wnd_base_;
+        }
+    }
+
+    // once per rtt (or KCP_TUNE_EPOCH): a remote that filled most of the
+    // window while little waited for recv() is window limited, double it.
+    // Halve it when more than half of it waits for recv().
+    template <typename Config>
+    void BasicKcpp<Config>::tune_rcv_wnd()
+    {
+        if constexpr (!Config::fixed)
+        {
+            uint32_t epoch = rx_srtt_ > 0 ? std::max(static_cast<uint32_t>(rx_srtt_), interval_) : KCP_TUNE_EPOCH * unit_;
+            if (_itimediff(current_, ts_tune_) < static_cast<int64_t>(epoch))
+            {
+                return;
+            }
+            uint32_t arrived = rcv_nxt_ - tune_nxt_;
+            ts_tune_ = current_;
+            tune_nxt_ = rcv_nxt_;
+
+            uint32_t wnd = cfg_.rcv_wnd;
+            uint32_t queued = rcv_queued();
+            if (queued > wnd / 2)
+            {
+                wnd = std::max({rcv_wnd_base_, wnd / 2, wnd_adv_peak_});
+            }
+            else if (arrived >= wnd - wnd / 4 && queued < wnd / 4)
+            {
+                // the 16 bit wnd field can not tell more
+                uint32_t cap = 0xffffu << ((opt_ & KCP_OPT_WSCALE) ? wscale_ : 0);
+                wnd = std::max(cfg_.rcv_wnd, std::min({wnd * 2, rcv_tune_max_, cap}));
+            }
+            if (wnd == cfg_.rcv_wnd)
+            {
+                return;
+            }
+
+            uint64_t reserve = static_cast<uint64_t>(wnd - rcv_wnd_base_) * mss_;
+            if (reserve > rcv_reserved_)
+            {
+                uint64_t grow = reserve - rcv_reserved_;
+                uint64_t used = KcpRcvMemory::used.fetch_add(grow) + grow;
+                uint64_t limit = KcpRcvMemory::limit;
+                if (limit > 0 && used > limit) // the process is at its ceiling
+                {
+                    KcpRcvMemory::used -= grow;
+                    return;
+                }
+            }
+            else
+            {
+                KcpRcvMemory::used -= rcv_reserved_ - reserve;
+            }
+            rcv_reserved_ = reserve;
+            cfg_.rcv_wnd = wnd;
+        }
+    }
+
+    // offer window scaling to the remote, the 16 bit wnd field is shifted
+    // by wscale once both sides have agreed on it
+    template <typename Config>
+    bool BasicKcpp<Config>::set_wndscale(int wscale)
+    {
+        if (wscale < 0 || wscale > static_cast<int>(KCP_WSCALE_MAX))
+        {
+            return false;
+        }
+        wscale_ = wscale;
+        set_option(KCP_OPT_WSCALE, wscale_ > 0);
+        return true;
+    }
+
+    // change the options offered to the remote, and renegotiate
+    template <typename Config>
+    void BasicKcpp<Config>::set_option(uint8_t option, bool enable)
+    {
+        if (enable)
+        {
+            opt_local_ |= option;
+        }
+        else
+        {
+            opt_local_ &= ~option;
+        }
+
+        opt_echoed_ = false;
+        ts_opts_ = current_;
+        update_opts();
+    }
+
+    // size of data that has not been send
+    template <typename Config>
+    int BasicKcpp<Config>::wait_send_size()
+    {
+        size_t count = nsnd_buf_ + send_queue_.size() - files_.size(); // without the placeholders
+        for (auto &file : files_)
+        {
+            count += (file.len + mss_ - 1) / mss_;
+        }
+        return static_cast<int>(count);
+    }
+
+    // send data
+    // push data into send queue
+    template <typename Config>
+    int BasicKcpp<Config>::send(const char *data, int len, uint16_t stream, uint32_t lifetime)
+    {
+        assert(mss_ > 0); // mss must be set
+        assert(len >= 0); // len must be positive
+
+        // 0 means reliable
+        uint64_t expire = lifetime > 0 ? std::max<uint64_t>(current_ + lifetime, 1) : 0;
+        uint8_t cmd = KCP_CMD_PUSH;
+
+        // compress the whole message before fragmentation, not in streaming mode
+        if ((opt_ & KCP_OPT_COMPRESS) && !cfg_.stream && data && len >= static_cast<int>(KCP_COMPRESS_MIN))
+        {
+            if (zskip_ > 0) // recent messages were incompressible
+            {
+                zskip_--;
+            }
+            else
+            {
+                // not worth it unless 1/16 is saved
+                int capacity = len - len / 16 - static_cast<int>(KCP_ZHEAD);
+                if (zbuf_.size() < KCP_ZHEAD + capacity)
+                {
+                    zbuf_.resize(KCP_ZHEAD + capacity);
+                }
+
+                int size = lz_compress(data, len, zbuf_.data() + KCP_ZHEAD, capacity);
+                if (size > 0)
+                {
+                    wire_store32(zbuf_.data(), static_cast<uint32_t>(len));
+                    data = zbuf_.data();
+                    len = static_cast<int>(KCP_ZHEAD) + size;
+                    cmd = KCP_CMD_PUSHZ;
+                    zfail_ = 0;
+                }
+                else // back off exponentially
+                {
+                    zfail_ = std::min(zfail_ + 1, KCP_COMPRESS_BACKOFF);
+                    zskip_ = (1u << zfail_) - 1;
+                }
+            }
+        }
+
+        // append to previous segment in streaming mode (if possible)
+        if (cfg_.stream != false)
+        {
+            if (!send_queue_.empty())
+            {
+                auto &old = send_queue_.back();
+                uint32_t oldlen = old->msg_.header().len;
+
+                if (oldlen < mss_ && old->expire == expire && old->msg_.header().cmd == KCP_CMD_PUSH &&
+                    (!multistream_ || _stream_id(old->msg_.data()) == stream))
+                {
+                    int capacity = mss_ - oldlen;
+                    int extend = std::min(len, capacity);
+
+                    kcpSegPtr seg = std::make_unique<kcpSeg>(oldlen + extend);
+
+                    old->copy_data2buf(seg->msg_.data());
+
+                    if (data)
+                    {
+                        memcpy(seg->msg_.data() + oldlen, data, extend);
+                        data += extend;
+                    }
+
+                    seg->msg_.header().cmd = KCP_CMD_PUSH;
+                    seg->msg_.header().len = oldlen + extend;
+                    seg->msg_.header().frg = 0;
+                    seg->expire = expire;
+                    len -= extend;
+                    old = std::move(seg);
+                    queue_bytes(extend);
+                }
+            }
+
+            if (len <= 0)
+            {
+                return 0;
+            }
+        }
+
+        return send_fragments(data, len, cmd, stream, expire, nullptr, send_queue_);
+    }
+
+    template <typename Config>
+    int BasicKcpp<Config>::send(std::shared_ptr<const char> data, int len, uint16_t stream, uint32_t lifetime)
+    {
+        assert(mss_ > 0); // mss must be set
+        assert(len >= 0); // len must be positive
+
+        // a stream header in front, merging and compression need a copy
+        if (!data || len == 0 || multistream_ || cfg_.stream ||
+            ((opt_ & KCP_OPT_COMPRESS) && len >= static_cast<int>(KCP_COMPRESS_MIN)))
+        {
+            return send(data.get(), len, stream, lifetime);
+        }
+
+        uint64_t expire = lifetime > 0 ? std::max<uint64_t>(current_ + lifetime, 1) : 0;
+        return send_fragments(data.get(), len, KCP_CMD_PUSH, stream, expire, data, send_queue_);
+    }
+
+    template <typename Config>
+    int BasicKcpp<Config>::send(std::vector<char> &&data, uint16_t stream, uint32_t lifetime)
+    {
+        auto owner = std::make_shared<std::vector<char>>(std::move(data));
+        int len = static_cast<int>(owner->size());
+        return send(std::shared_ptr<const char>(owner, owner->data()), len, stream, lifetime);
+    }
+
+    template <typename Config>
+    int BasicKcpp<Config>::send_file(int fd, uint64_t offset, uint64_t len, uint16_t stream)
+    {
+#ifdef KCP_HAS_MMAP
+        // a file must hold the whole range, a pipe or socket is read from
+        // where it is and must block
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            return -1;
+        }
+        bool regular = S_ISREG(st.st_mode);
+        if (regular ? offset > static_cast<uint64_t>(st.st_size) || len > static_cast<uint64_t>(st.st_size) - offset
+                    : offset != 0 || (fcntl(fd, F_GETFL) & O_NONBLOCK) != 0)
+        {
+            return -1;
+        }
+        if (len == 0)
+        {
+            return 0;
+        }
+        int dup_fd = dup(fd);
+        if (dup_fd < 0)
+        {
+            return -1;
+        }
+        files_.push_back(FileSend{dup_fd, offset, len, stream, regular});
+        queue_bytes(len);
+
+        // keeps the place of the file in the queue, see mv_queue_to_buf
+        kcpSegPtr seg = std::make_unique<kcpSeg>();
+        seg->msg_.header().cmd = KCP_CMD_FILE;
+        send_queue_.push_back(std::move(seg));
+        return 0;
+#else
+        (void)fd;
+        (void)offset;
+        (void)len;
+        (void)stream;
+        return -1;
+#endif
+    }
+
+    // queue the next message of files_.front() in front of its placeholder,
+    // returns false once the file is done
+    template <typename Config>
+    bool BasicKcpp<Config>::load_file()
+    {
+#ifdef KCP_HAS_MMAP
+        FileSend &file = files_.front();
+        uint32_t head = multistream_ ? KCP_STREAM_HEAD : 0;
+        uint64_t size = std::min<uint64_t>(file.len, static_cast<uint64_t>(mss_ - head) * KCP_FILE_FRAGMENTS);
+        kcpSegList queue;
+
+        // do not map past the end should the file have shrunk since
+        // send_file(). This does not cover parts mapped already, see
+        // send_file() in kcpp.h
+        struct stat st;
+        if (size > 0 && file.regular)
+        {
+            uint64_t end = fstat(file.fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+            size = std::min<uint64_t>(size, end > file.offset ? end - file.offset : 0);
+        }
+
+        if (size > 0)
+        {
+            // mmap wants a page aligned offset
+            static const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+            uint64_t skew = file.offset % page;
+            size_t length = static_cast<size_t>(skew + size);
+            void *addr = file.regular ? mmap(nullptr, length, PROT_READ, MAP_SHARED, file.fd,
+                                             static_cast<off_t>(file.offset - skew))
+                                      : MAP_FAILED;
+
+            std::shared_ptr<const char> map;
+            if (addr != MAP_FAILED)
+            {
+                madvise(addr, length, MADV_WILLNEED); // read ahead while it waits for flush
+                map.reset(static_cast<const char *>(addr) + skew,
+                          [addr, length](const char *) { munmap(addr, length); });
+            }
+            else // a pipe, or no mapping, read it instead
+            {
+                auto copy = std::make_shared<std::vector<char>>(size);
+                uint64_t done = 0;
+                while (done < size)
+                {
+                    char *p = copy->data() + done;
+                    size_t want = static_cast<size_t>(size - done);
+                    ssize_t n = file.regular ? pread(file.fd, p, want, static_cast<off_t>(file.offset + done))
+                                             : read(file.fd, p, want);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        break;
+                    done += static_cast<uint64_t>(n);
+                }
+                size = done;
+                if (done > 0)
+                {
+                    map = std::shared_ptr<const char>(copy, copy->data());
+                }
+            }
+
+            if (map)
+            {
+                // the stream header goes in front of the data, so multistream copies
+                send_fragments(map.get(), static_cast<int>(size), KCP_CMD_PUSH, file.stream, 0,
+                               multistream_ ? nullptr : map, queue);
+                snd_queued_bytes_ -= size; // counted by send_file()
+                file.offset += size;
+                file.len -= size;
+            }
+        }
+        if (size == 0 && file.len > 0) // short or unreadable, the rest of the file is not sent
+        {
+            KCP_COUNT(file_short, file.len);
+            snd_queued_bytes_ -= file.len;
+            file.len = 0;
+        }
+
+        if (queue.empty())
+        {
+            close(file.fd);
+            files_.pop_front();
+            return false;
+        }
+        send_queue_.splice(send_queue_.begin(), queue);
+        return true;
+#else
+        files_.pop_front();
+        return false;
+#endif
+    }
+
+    // split a message into queue, the segments point into ref when it is
+    // set, otherwise they get a copy
+    template <typename Config>
+    int BasicKcpp<Config>::send_fragments(const char *data, int len, uint8_t cmd, uint16_t stream, uint64_t expire,
+                                          const std::shared_ptr<const char> &ref, kcpSegList &queue)
+    {
+        // every fragment starts with the stream header in multistream mode
+        uint32_t head = multistream_ ? KCP_STREAM_HEAD : 0;
+        uint32_t mss = mss_ - head;
+
+        int count = 0;
+        if (len <= static_cast<int>(mss))
+            count = 1;
+        else
+            count = (len + mss - 1) / mss;
+
+        // the remote must be able to hold all fragments in its window: any
+        // window is KCP_WND_RCV, a larger one once it has advertised it.
+        // frg is 8 bits.
+        if (count >= static_cast<int>(std::max(KCP_WND_RCV, rmt_wnd_peak_)))
+            return -2;
+
+        if (count == 0)
+            count = 1;
+
+        // fragment ,just set len and frg in header ,other data will be set in mv_queue_to_buf
+        for (int i = 0; i < count; i++)
+        {
+            int size = std::min(len, static_cast<int>(mss));
+            kcpSegPtr seg = ref ? std::make_unique<kcpSeg>(ref, static_cast<int>(data - ref.get()))
+                                : std::make_unique<kcpSeg>(size + head);
+
+            if (multistream_) // stream sn is set in mv_queue_to_buf
+            {
+                wire_store16(seg->msg_.data(), stream);
+            }
+
+            if (!ref && data && len > 0)
+            {
+                memcpy(seg->msg_.data() + head, data, size);
+            }
+
+            seg->msg_.header().cmd = cmd;
+            seg->msg_.header().len = size + head;
+            seg->msg_.header().frg = cfg_.stream ? 0 : (count - i - 1);
+            seg->expire = expire;
+            if (expire != 0)
+            {
+                nsnd_expire_++;
+            }
+
+            queue_bytes(size + head);
+            queue.push_back(std::move(seg));
+            if (data)
+            {
+                data += size;
+            }
+            len -= size;
+        }
+
+        return 0;
+    }
+
+    // receive data
+    // mv data from rcv_queue to buffer
+    template <typename Config>
+    int BasicKcpp<Config>::recv(char *buffer, int len, uint16_t stream)
+    {
+        assert(len >= 0);          // len must be positive
+        assert(buffer != nullptr); // buffer must be valid
+
+        kcpSegList *queue = &rcv_queue_;
+        uint32_t head = 0;
+        if (multistream_)
+        {
+            auto it = streams_.find(stream);
+            if (it == streams_.end()) // no data
+            {
+                return -1;
+            }
+            queue = &it->second.rcv_queue;
+            head = KCP_STREAM_HEAD;
+        }
+
+        int peeksize = peek_size(stream);
+        bool recover_flag = false;
+
+        if (queue->empty()) // no data
+        {
+            return -1;
+        }
+        else if (peeksize < 0) // no data
+        {
+            return -2;
+        }
+        else if (peeksize > len) // buffer is not enough
+        {
+            return -3;
+        }
+
+        // the window advertised is 0, also with up to 2^wscale - 1 slots free
+        if (wnd_adv() == 0)
+        {
+            recover_flag = true;
+        }
+
+        // a compressed message is reassembled in zbuf first
+        bool packed = queue->front()->msg_.header().cmd == KCP_CMD_PUSHZ;
+        if (packed)
+        {
+            zbuf_.clear();
+        }
+
+        len = 0;
+
+        for (auto it = queue->begin(); it != queue->end();)
+        {
+            int fragment = (*it)->msg_.header().frg;
+            int size = (*it)->msg_.header().len - head;
+            const char *data = (*it)->msg_.data() + head;
+            if (packed)
+            {
+                zbuf_.insert(zbuf_.end(), data, data + size);
+            }
+            else
+            {
+                memcpy(buffer, data, size);
+                buffer += size;
+                len += size;
+            }
+
+            rcv_bytes_ -= (*it)->msg_.header().len;
+            it = queue->erase(it);
+            if (multistream_)
+            {
+                nrcv_stream_--;
+            }
+
+            if (fragment == 0)
+                break;
+        }
+
+        if (packed)
+        {
+            len = -4; // corrupted, the message is gone
+            if (peeksize > 0 && zbuf_.size() >= KCP_ZHEAD &&
+                lz_decompress(zbuf_.data() + KCP_ZHEAD, static_cast<int>(zbuf_.size() - KCP_ZHEAD), buffer, peeksize) == peeksize)
+            {
+                len = peeksize;
+            }
+            else
+            {
+                KCP_COUNT(corrupt_dropped, 1);
+            }
+        }
+
+        // move available data from rcv_buf -> rcv_queue
+        mv_buf_to_queue();
+
+        if (recover_flag && wnd_adv() > 0)
+        {
+            // ready to send back IKCP_CMD_WINS in ikcp_flush
+            // tell remote my window size
+            probe_ |= KCP_ASK_TELL;
+        }
+
+        return len;
+    }
+
+    // update state (call it repeatedly, every 10ms-100ms), or you can ask
+    template <typename Config>
+    void BasicKcpp<Config>::update(uint32_t current)
+    {
+        update64(extend_clock(current));
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::update64(uint64_t current)
+    {
+        current_ = current;
+        if (updated_ == false) // first call
+        {
+            updated_ = true;
+            ts_flush_ = current_ + interval_;
+        }
+        int64_t slap = _itimediff(current_, ts_flush_); // time diff
+        int64_t limit = 10000 * static_cast<int64_t>(unit_);
+        if (slap >= limit || slap < -limit)             // time diff is too big
+        {
+            ts_flush_ = current_;
+            slap = 0;
+        }
+        if (slap >= 0) // time diff is ok
+        {
+            ts_flush_ += interval_;
+            if (current_ - ts_flush_ >= interval_)
+            {
+                ts_flush_ = current_ + interval_;
+            }
+            flush();
+        }
+    }
+
+    template <typename Config>
+    int32_t BasicKcpp<Config>::check(uint32_t current)
+    {
+        return static_cast<int32_t>(static_cast<uint32_t>(check64(extend_clock(current))));
+    }
+
+    template <typename Config>
+    uint64_t BasicKcpp<Config>::check64(uint64_t current)
+    {
+        uint64_t ts_flush = ts_flush_;
+        int64_t tm_flush = std::numeric_limits<int64_t>::max();
+        int64_t tm_packet = std::numeric_limits<int64_t>::max();
+        int64_t minimal = 0;
+        int64_t limit = 10000 * static_cast<int64_t>(unit_);
+
+        if (updated_ == false)
+        {
+            return current;
+        }
+
+        if (_itimediff(current, ts_flush) >= limit ||
+            _itimediff(current, ts_flush) < -limit)
+        {
+            ts_flush = current;
+        }
+
+        if (current >= ts_flush)
+        {
+            return current;
+        }
+
+        tm_flush = _itimediff(ts_flush, current);
+
+        for (auto &seg : send_buf_)
+        {
+            if (!seg) // acked
+                continue;
+            int64_t diff = _itimediff(seg->resendts, current);
+            if (diff <= 0)
+            {
+                return current;
+            }
+            if (diff < tm_packet)
+                tm_packet = diff;
+        }
+
+        minimal = std::min(tm_packet, tm_flush);
+        if (minimal >= interval_)
+            minimal = interval_;
+
+        return current + minimal;
+    }
+
+    // the 64 bit time closest to the last update() with these low 32 bits
+    template <typename Config>
+    uint64_t BasicKcpp<Config>::extend_clock(uint32_t current) const
+    {
+        if (updated_ == false)
+        {
+            return current;
+        }
+        int32_t diff = static_cast<int32_t>(current - static_cast<uint32_t>(current_));
+        return current_ + static_cast<uint64_t>(static_cast<int64_t>(diff));
+    }
+
+    // callback function, data has tail_ bytes of room after size
+    template <typename Config>
+    int BasicKcpp<Config>::output(char *data, int size)
+    {
+        if (size == 0)
+            return 0;
+        ts_active_ = current_;
+        compacted_ = false;
+        KCP_COUNT(datagrams_sent, 1);
+        if (sealed_)
+        {
+            // salt and counter are the XChaCha20 nonce and the associated
+            // data, sent in clear
+            char *tail = data + size;
+            uint8_t nonce[AEAD_NONCE_LEN] = {0};
+            for (int i = 0; i < 8; i++)
+            {
+                nonce[4 + i] = static_cast<uint8_t>(seal_nxt_ >> (i * 8));
+            }
+            seal_nxt_++;
+            memcpy(tail, tx_salt_.data(), KCP_SEAL_SALT);
+            memcpy(tail + KCP_SEAL_SALT, nonce + 4, 8);
+            aead_seal(tx_key_.data(), nonce, tail, KCP_SEAL_SALT + 8, data, size,
+                      reinterpret_cast<uint8_t *>(tail + KCP_SEAL_SALT + 8));
+            size += KCP_SEAL_OVERHEAD;
+        }
+        if (checksum_)
+        {
+            uint32_t crc = crc32c(0, data, size);
+            for (int i = 0; i < 4; i++)
+            {
+                data[size++] = static_cast<char>(crc >> (i * 8));
+            }
+        }
+        return output_(data, size, this, this->user_);
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::update_probe()
+    {
+        if (rmt_wnd_ == 0)
+        {
+            if (probe_wait_ == 0)
+            {
+                probe_wait_ = KCP_PROBE_INIT * unit_;
+                ts_probe_ = current_ + probe_wait_;
+            }
+            else
+            {
+                if (current_ >= ts_probe_)
+                {
+                    if (probe_wait_ < KCP_PROBE_INIT * unit_)
+                        probe_wait_ = KCP_PROBE_INIT * unit_;
+
+                    probe_wait_ += probe_wait_ / 2;
+
+                    if (probe_wait_ > KCP_PROBE_LIMIT * unit_)
+                        probe_wait_ = KCP_PROBE_LIMIT * unit_;
+
+                    ts_probe_ = current_ + probe_wait_;
+                    probe_ |= KCP_ASK_SEND;
+                }
+            }
+        }
+        else
+        {
+            ts_probe_ = 0;
+            probe_wait_ = 0;
+        }
+    }
+
+    // flush exist data
+    template <typename Config>
+    void BasicKcpp<Config>::flush()
+    {
+
+        // 'update' haven't been called.
+        if (updated_ == false)
+        {
+            return;
+        }
+        char *ptr = buffer_; // nullptr until something is written, see try_output
+        KCP_PROFILE_BEGIN();
+
+        // before any wnd goes out
+        if (rcv_tune_max_ > 0)
+        {
+            tune_rcv_wnd();
+        }
+
+        // flush acknowledges
+        ptr = flush_ack(ptr);
+        KCP_PROFILE_LAP(KCP_PHASE_FLUSH_ACK);
+
+        // probe window size (if remote window size equals zero)
+        update_probe();
+        KCP_PROFILE_LAP(KCP_PHASE_UPDATE_PROBE);
+        // flush window probing commands
+        ptr = flush_window_probe(ptr);
+        KCP_PROFILE_LAP(KCP_PHASE_WINDOW_PROBE);
+
+        // drop stale messages before they take a sn
+        if (nsnd_expire_ > 0)
+        {
+            drop_expired();
+        }
+
+        // move data from snd_queue to snd_buf
+        mv_queue_to_buf();
+        KCP_PROFILE_LAP(KCP_PHASE_MV_QUEUE);
+        // flush data segments
+        ptr = flush_data(ptr);
+        KCP_PROFILE_LAP(KCP_PHASE_FLUSH_DATA);
+
+        // flush remain segments
+        int size = static_cast<int>(ptr - buffer_);
+        if (size > 0)
+        {
+            output(buffer_, size);
+        }
+        notify(rcv_bytes_);
+
+        if (!compacted_ && _itimediff(current_, ts_active_) >= static_cast<int64_t>(KCP_IDLE_COMPACT) * unit_)
+        {
+            compact();
+        }
+        KCP_PROFILE_LAP(KCP_PHASE_FLUSH_TAIL);
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::set_trace(uint32_t capacity)
+    {
+        trace_.reset(capacity > 0 ? new KcpTrace(capacity) : nullptr);
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::trace_cwnd()
+    {
+        if (trace_ && trace_->cwnd != cwnd_)
+        {
+            trace_->cwnd = cwnd_;
+            trace_->record(KCP_TRACE_CWND, static_cast<uint32_t>(current_), ssthresh_, cwnd_);
+        }
+    }
+
+    template <typename Config>
+    KcpStats BasicKcpp<Config>::stats() const
+    {
+        KcpStats stats;
+#if KCP_STATS
+        static_cast<KcpCounters &>(stats) = counters_;
+#endif
+        stats.srtt = rx_srtt_;
+        stats.rttvar = rx_rttval_;
+        stats.rto = rx_rto_;
+        stats.cwnd = cwnd_;
+        stats.ssthresh = ssthresh_;
+        stats.snd_wnd = cfg_.snd_wnd;
+        stats.rcv_wnd = cfg_.rcv_wnd;
+        stats.rmt_wnd = rmt_wnd_;
+        stats.nsnd_buf = nsnd_buf_;
+        stats.nsnd_queue = static_cast<uint32_t>(send_queue_.size());
+        stats.nrcv_queue = static_cast<uint32_t>(rcv_queue_.size()) + nrcv_stream_;
+        return stats;
+    }
+
+    template <typename Config>
+    KcpProfile BasicKcpp<Config>::profile() const
+    {
+#if KCP_PROFILE
+        return profile_;
+#else
+        return KcpProfile();
+#endif
+    }
+
+    template <typename Config>
+    bool BasicKcpp<Config>::compact()
+    {
+        if (!send_queue_.empty() || !send_buf_.empty() || !rcv_buf_.empty() || !rcv_queue_.empty() ||
+            !acklist_.empty() || nrcv_stream_ > 0)
+        {
+            return false;
+        }
+        storage_.release();
+        buffer_ = storage_.data();
+        send_buf_.shrink_to_fit();
+        rcv_buf_.shrink_to_fit();
+        AckList().swap(acklist_);
+        std::vector<char>().swap(zbuf_);
+        std::vector<char>().swap(rbuf_);
+        compacted_ = true;
+        return true;
+    }
+
+    template <typename Config>
+    int BasicKcpp<Config>::peek_size(uint16_t stream)
+    {
+        kcpSegList *queue = &rcv_queue_;
+        uint32_t head = 0;
+        if (multistream_)
+        {
+            auto it = streams_.find(stream);
+            if (it == streams_.end()) // no data
+            {
+                return -1;
+            }
+            queue = &it->second.rcv_queue;
+            head = KCP_STREAM_HEAD;
+        }
+
+        if (queue->empty()) // no data
+        {
+            return -1;
+        }
+
+        auto &seg = queue->front();
+
+        if (seg->msg_.header().frg != 0 && queue->size() < seg->msg_.header().frg + 1u) // no enough segments
+        {
+            return -1;
+        }
+
+        if (seg->msg_.header().cmd == KCP_CMD_PUSHZ) // size before compression
+        {
+            // 0 for a size the data can not decompress to, recv() drops it
+            uint32_t packed = 0, raw = 0;
+            for (auto &frag : *queue)
+            {
+                packed += frag->msg_.header().len - head;
+                if (frag->msg_.header().frg == 0)
+                {
+                    break;
+                }
+            }
+            if (seg->msg_.header().len >= head + KCP_ZHEAD)
+            {
+                raw = wire_load32(seg->msg_.data() + head);
+            }
+            if (packed < KCP_ZHEAD || raw > static_cast<uint32_t>(lz_decompress_bound(static_cast<int>(packed - KCP_ZHEAD))))
+            {
+                return 0;
+            }
+            return static_cast<int>(raw);
+        }
+
+        if (seg->msg_.header().frg == 0) // only one segment
+        {
+            return seg->msg_.header().len - head;
+        }
+
+        int length = 0;
+        for (auto &seg : *queue) // calculate length
+        {
+            length += seg->msg_.header().len - head;
+            if (seg->msg_.header().frg == 0) // last segment
+            {
+                break;
+            }
+        }
+        return length;
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::parse_fastack(uint32_t sn, uint32_t ts)
+    {
+
+        if (_itimediff(sn, snd_una_) < 0 || _itimediff(sn, snd_nxt_) >= 0) // invalid sn
+            return;
+
+        // every segment before sn has been skipped by this ack
+        uint32_t count = sn - snd_una_;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            auto &seg = send_buf_[i];
+            if (!seg) // acked
+                continue;
+    #ifndef KCP_FASTACK_CONSERVE
+            seg->fastack++;
+    #else
+            if (_itimediff(ts, seg->msg_.header().ts) >= 0)
+                seg->fastack++;
+    #endif
+        }
+    }
+
+    template <typename Config>
+    void BasicKcpp<Config>::update_ack(int rtt)
+    {
+        int32_t rto = 0;
+        if (rx_srtt_ == 0) // first time
+        {
+            rx_srtt_ = rtt;
+            rx_rttval_ = rtt / 2;
+        }
+        else
+        {
+            long delta = rtt - rx_srtt_;
+            if (delta < 0)
+                delta = -delta;
+
+            rx_rttval_ = (3 * rx_rttval_ + delta) / 4;
+            rx_srtt_ = (7 * rx_srtt_ + rtt) / 8;
+            if (rx_srtt_ < 1)
+                rx_srtt_ = 1;
+        }
+
+        rto = rx_srtt_ + std::max(interval_, static_cast<uint32_t>(4 * rx_rttval_));
+
+        rx_rto_ = std::min(static_cast<uint32_t>(std::max(rx_minrto_, rto)), KCP_RTO_MAX * unit_);
+    }
+
+    // an ack of a retransmitted segment which echoes the ts of a transmission
+    // before the first retransmission means that one was spurious (Eifel
+    // detection). An echo of a later retransmission says nothing: the first
+    // one may have been lost as well.
+    template <typename Config>
+    void BasicKcpp<Config>::check_spurious(uint32_t sn, uint32_t ts)
+    {
+        if (_itimediff(sn, snd_una_) < 0 || _itimediff(sn, snd_nxt_) >= 0) // out of range
+        {
+            return;
+        }
+
+        // a skip replaces the data after its lifetime, it is no retransmission
+        auto &seg = send_buf_[sn - snd_una_];
+        if (seg && seg->xmit > 1 && seg->msg_.header().cmd != KCP_CMD_SKIP)
+        {
+            if (_itimediff(ts, seg->ts_resent) < 0) // acked the original transmission
+            {
+                undo_spurious(ts);
+            }
+            else // the retransmission was needed, keep the reduction
+            {
+                undo_pending_ = false;
+            }
+        }
+    }
+
+    // restore the cwnd saved before the spurious reduction
+    template <typename Config>
+    void BasicKcpp<Config>::undo_spurious(uint32_t ts)
+    {
+        int32_t rtt = static_cast<int32_t>(static_cast<uint32_t>(current_) - ts);
+
+        cwnd_ = std::max(cwnd_, undo_cwnd_);
+        ssthresh_ = std::max(ssthresh_, undo_ssthresh_);
+        incr_ = std::max(incr_, undo_incr_);
+        undo_pending_ = false;
+
+        // the delayed ack is a valid rtt sample, make the rto cover it at once
+        if (rtt > 0)
+        {
+            rx_srtt_ = std::max(rx_srtt_, rtt);
+            rx_rttval_ = std::max(rx_rttval_, rtt / 2);
+            int32_t rto = rx_srtt_ + std::max(interval_, static_cast<uint32_t>(4 * rx_rttval_));
+            rx_rto_ = std::min(static_cast<uint32_t>(std::max(rx_minrto_, rto)), KCP_RTO_MAX * unit_);
+        }
+    }
+
+    // remove the first snd_buf segment which sn equals to 'sn'
+    template <typename Config>
+    void BasicKcpp<Config>::remove_ack(uint32_t sn)
+    {
+
+        if (_itimediff(sn, snd_una_) < 0 || _itimediff(sn, snd_nxt_) >= 0) // out of range
+        {
+            return;
+        }
+
+        // leave a hole, shrink_buf drops it once it reaches the front
+        auto &seg = send_buf_[sn - snd_una_];
+        if (seg)
+        {
+            snd_flight_bytes_ -= seg->msg_.header().len;
+            seg.reset();
+            nsnd_buf_--;
+        }
+    }
+
+    // check if the data is repeat, if repeat throw it away , else put it into rcv_buf
+    template <typename Config>
+    void BasicKcpp<Config>::check_data_repeat(kcpSegPtr newseg)
+    {
+        uint32_t sn = newseg->msg_.header().sn;
+        bool repeat_flag = false;
+
+        if (_itimediff(sn, rcv_nxt_ + cfg_.rcv_wnd) >= 0 || _itimediff(sn, rcv_nxt_) < 0) // out of window
+        {
+            return;
+        }
+
+        // rcv_buf is indexed by sn - rcv_nxt, missing segments are holes
+        uint32_t index = sn - rcv_nxt_;
+        if (index >= rcv_buf_.size())
+        {
+            rcv_buf_.resize(index + 1);
+        }
+
+        if (rcv_buf_[index].got) // repeat
+        {
+            repeat_flag = true;
+            KCP_COUNT(dup_dropped, 1);
+        }
+
+        if (repeat_flag == false)
+        {
+            if (index > 0)
+            {
+                KCP_TRACE(KCP_TRACE_OUTOFORDER, sn, rcv_nxt_);
+            }
+            rcv_buf_[index].got = true;
+            if (multistream_) // ordered by its own stream, not by sn
+            {
+                route_stream(std::move(newseg));
+            }
+            else
+            {
+                rcv_buf_[index].seg = std::move(newseg);
+            }
+        }
+
+        // move available data from rcv_buf to rcv_queue
+        mv_buf_to_queue();
+    }
+
+    // remove the segments before una from snd_buf
+    template <typename Config>
+    void BasicKcpp<Config>::remove_before_una(uint32_t una)
+    {
+        while (!send_buf_.empty() && _itimediff(una, snd_una_) > 0)
+        {
+            if (send_buf_.front())
+            {
+                snd_flight_bytes_ -= send_buf_.front()->msg_.header().len;
+                nsnd_buf_--;
+            }
+            send_buf_.pop_front();
+            snd_una_++;
+        }
+    }
+
+    // if snd_buf is empty, reset snd_una and snd_nxt
+    template <typename Config>
+    void BasicKcpp<Config>::shrink_buf()
+    {
+        while (!send_buf_.empty() && !send_buf_.front()) // acked holes
+        {
+            send_buf_.pop_front();
+        }
+        snd_una_ = snd_nxt_ - static_cast<uint32_t>(send_buf_.size());
+    }
+
+    // get data from UDP
+    template <typename Config>
+    int BasicKcpp<Config>::input(const char *data, uint32_t size)
+    {
+        // if data is empty OR size is less than KCP_OVERHEAD,  data is invalid
+        if (data == nullptr || size < KCP_OVERHEAD + tail_)
+            return -1;
+        KCP_PROFILE_BEGIN();
+
+        // check and authenticate before anything is parsed
+        if (checksum_)
+        {
+            size -= KCP_CRC_LEN;
+            const uint8_t *tail = reinterpret_cast<const uint8_t *>(data + size);
+            uint32_t crc = static_cast<uint32_t>(tail[0]) | (static_cast<uint32_t>(tail[1]) << 8) |
+                           (static_cast<uint32_t>(tail[2]) << 16) | (static_cast<uint32_t>(tail[3]) << 24);
+            if (crc32c(0, data, size) != crc)
+            {
+                return -4;
+            }
+        }
+        if (sealed_)
+        {
+            size -= KCP_SEAL_OVERHEAD;
+            const char *tail = data + size;
+            const uint8_t *salt = reinterpret_cast<const uint8_t *>(tail);
+            uint8_t nonce[AEAD_NONCE_LEN] = {0};
+            memcpy(nonce + 4, tail + KCP_SEAL_SALT, 8);
+            if (rbuf_.size() < size)
+            {
+                rbuf_.resize(size);
+            }
+
+            // the subkey of a new remote salt is kept once a datagram opens
+            std::array<uint8_t, AEAD_KEY_LEN> subkey;
+            bool salted = !rx_keyed_ || memcmp(salt, rx_salt_.data(), KCP_SEAL_SALT) != 0;
+            if (salted)
+            {
+                hchacha20(rx_key_.data(), salt, subkey.data());
+            }
+            if (!aead_open(salted ? subkey.data() : rx_subkey_.data(), nonce, tail, KCP_SEAL_SALT + 8, data, size,
+                           reinterpret_cast<const uint8_t *>(tail + KCP_SEAL_SALT + 8), rbuf_.data()))
+            {
+                return -4;
+            }
+            if (salted)
+            {
+                rx_subkey_ = subkey;
+                memcpy(rx_salt_.data(), salt, KCP_SEAL_SALT);
+                rx_keyed_ = true;
+            }
+            data = rbuf_.data();
+        }
+
+        KCP_PROFILE_LAP(KCP_PHASE_INPUT_AUTH);
+        KCP_COUNT(datagrams_received, 1);
+        uint32_t prev_una = snd_una_;
+        uint64_t buffered = rcv_bytes_;
+        uint32_t maxack = 0;
+        uint32_t latest_ts = 0;
+        bool flag = false;
+        bool compact = false;
+        kcpHeader prev;
+
+        while (true)
+        {
+            kcpSeg segment;
+
+            if (!compact)
+            {
+                if (size < static_cast<int>(KCP_OVERHEAD))
+                    break;
+
+                segment.parse_header(data);
+                data += KCP_OVERHEAD;
+                size -= KCP_OVERHEAD;
+
+                // the rest of the datagram uses compact headers
+                if (segment.msg_.header().cmd & KCP_CMD_COMPACT)
+                {
+                    segment.msg_.header().cmd &= ~KCP_CMD_COMPACT;
+                    compact = true;
+                }
+            }
+            else
+            {
+                if (size == 0)
+                    break;
+
+                int used = segment.parse_compact_header(data, size, prev);
+                if (used < 0)
+                    return -2;
+                data += used;
+                size -= used;
+            }
+            prev = segment.msg_.header();
+
+            if (segment.msg_.header().conv != conv_) // conv is not match
+            {
+                return -1;
+            }
+            else if (size < static_cast<int>(segment.msg_.header().len)) // data is imcomplete
+            {
+                return -1;
+            }
+
+            if (size < segment.msg_.header().len)
+            {
+                return -2;
+            }
+            if (static_cast<long>(segment.msg_.header().len) < 0 || static_cast<long>(size) < static_cast<long>(segment.msg_.header().len))
+            {
+                return -2;
+            }
+
+            if (segment.msg_.header().cmd != KCP_CMD_PUSH && segment.msg_.header().cmd != KCP_CMD_ACK &&
+                segment.msg_.header().cmd != KCP_CMD_WASK && segment.msg_.header().cmd != KCP_CMD_WINS &&
+                segment.msg_.header().cmd != KCP_CMD_OPTS && segment.msg_.header().cmd != KCP_CMD_SKIP &&
+                segment.msg_.header().cmd != KCP_CMD_PUSHZ)
+                return -3;
+
+            rmt_wnd_ = segment.msg_.header().wnd;
+            if (opt_ & KCP_OPT_WSCALE)
+            {
+                rmt_wnd_ <<= rmt_wscale_;
+            }
+            rmt_wnd_peak_ = std::max(rmt_wnd_peak_, std::min(rmt_wnd_, KCP_FRG_MAX));
+            if (undo_pending_ && segment.msg_.header().cmd == KCP_CMD_ACK)
+            {
+                // before una removes the segment
+                check_spurious(segment.msg_.header().sn, segment.msg_.header().ts);
+            }
+            remove_before_una(segment.msg_.header().una);
+            shrink_buf();
+            if (undo_pending_ && _itimediff(snd_una_, undo_recover_) >= 0)
+            {
+                // everything in flight at the reduction is acked, the
+                // snapshot is stale
+                undo_pending_ = false;
+            }
+
+            if (segment.msg_.header().cmd == KCP_CMD_ACK) // ACK
+            {
+                // ts is the low 32 bits of our clock, echoed
+                int32_t rtt = static_cast<int32_t>(static_cast<uint32_t>(current_) - segment.msg_.header().ts);
+                if (rtt >= 0)
+                {
+                    update_ack(rtt);
+                }
+                KCP_TRACE(KCP_TRACE_ACK, segment.msg_.header().sn, static_cast<uint32_t>(rtt));
+                remove_ack(segment.msg_.header().sn);
+                shrink_buf();
+                if (!flag)
+                {
+                    flag = true;
+                    maxack = segment.msg_.header().sn;
+                    latest_ts = segment.msg_.header().ts;
+                }
+                else
+                {
+                    if (_itimediff(segment.msg_.header().sn, maxack) > 0)
+                    {
+                        maxack = segment.msg_.header().sn;
+                        latest_ts = segment.msg_.header().ts;
+                    }
+                }
+                KCP_COUNT(acks_received, 1);
+            }
+            else if (segment.msg_.header().cmd == KCP_CMD_PUSH || segment.msg_.header().cmd == KCP_CMD_PUSHZ ||
+                     segment.msg_.header().cmd == KCP_CMD_SKIP) // PUSH, or a sn to skip over
+            {
+                if (_itimediff(segment.msg_.header().sn, rcv_nxt_ + cfg_.rcv_wnd) < 0)
+                {
+                    acklist_.push_back({segment.msg_.header().sn, segment.msg_.header().ts});
+                    KCP_COUNT(segs_received, 1);
+                    KCP_COUNT(bytes_received, segment.msg_.header().len);
+
+                    if (_itimediff(segment.msg_.header().sn, rcv_nxt_) >= 0)
+                    {
+                        kcpSegPtr seg = std::make_unique<kcpSeg>(segment.msg_.header().len);
+                        seg->msg_.header() = segment.msg_.header();
+
+                        if (segment.msg_.header().len > 0)
+                        {
+                            memcpy(seg->msg_.data(), data, segment.msg_.header().len);
+                        }
+                        check_data_repeat(std::move(seg));
+                    }
+                    else // delivered already
+                    {
+                        KCP_COUNT(dup_dropped, 1);
+                    }
+                }
+            }
+            else if (segment.msg_.header().cmd == KCP_CMD_WASK)
+            {
+                // ready to send back KCP_CMD_WINS in KCP_flush
+                // tell remote my window size
+                probe_ |= KCP_ASK_SEND;
+            }
+            else if (segment.msg_.header().cmd == KCP_CMD_WINS)
+            {
+                // do nothing
+            }
+            else if (segment.msg_.header().cmd == KCP_CMD_OPTS)
+            {
+                parse_opts(data, segment.msg_.header().len);
+            }
+
+            data += segment.msg_.header().len;
+            size -= segment.msg_.header().len;
+        }
+        KCP_PROFILE_LAP(KCP_PHASE_INPUT_PARSE);
+
+        if (flag)
+        {
+            parse_fastack(maxack, latest_ts);
+        }
+
+        if (_itimediff(snd_una_, prev_una) > 0) //
+        {
+            if (cwnd_ < rmt_wnd_)
+            {
+                uint32_t mss = mss_;
+                if (cwnd_ < ssthresh_)
+                {
+                    cwnd_++;
+                    incr_ += mss;
+                }
+                else
+                {
+                    if (incr_ < mss)
+                        incr_ = mss;
+                    incr_ += (mss * mss) / incr_ + (mss / 16);
+                    if ((cwnd_ + 1) * mss <= incr_)
+                    {
+                        cwnd_++;
+                    }
+                }
+                if (cwnd_ > rmt_wnd_)
+                {
+                    cwnd_ = rmt_wnd_;
+                    incr_ = rmt_wnd_ * mss_;
+                }
+            }
+        }
+
+        trace_cwnd();
+        notify(buffered);
+        KCP_PROFILE_LAP(KCP_PHASE_INPUT_ACK);
+        return 0;
+    }
+
+    //
+    template <typename Config>
+    int BasicKcpp<Config>::wnd_unused()
+    {
+        if (rcv_queued() < cfg_.rcv_wnd)
+            return static_cast<int>(cfg_.rcv_wnd - rcv_queued());
+        return 0;
+    }
+
+    // unused window as carried by the 16 bit wnd field. The remote may send
+    // messages as long as the largest one, so rcv_wnd keeps that size.
+    template <typename Config>
+    uint16_t BasicKcpp<Config>::wnd_adv()
+    {
+        uint32_t wnd = static_cast<uint32_t>(wnd_unused());
+        uint32_t shift = (opt_ & KCP_OPT_WSCALE) ? wscale_ : 0;
+        wnd = std::min(wnd >> shift, static_cast<uint32_t>(0xffff));
+        wnd_adv_peak_ = std::max(wnd_adv_peak_, std::min(wnd << shift, KCP_FRG_MAX));
+        return static_cast<uint16_t>(wnd);
+    }
+
+    // remote options received, or local options changed
+    template <typename Config>
+    void BasicKcpp<Config>::parse_opts(const char *data, uint32_t len)
+    {
+        if (len < KCP_OPTS_LEN) // malformed
+        {
+            return;
+        }
+
+        uint8_t flags = static_cast<uint8_t>(data[0]);
+        opt_remote_ = flags & ~(KCP_OPT_ECHO | KCP_OPT_ANSWER);
+        rmt_wscale_ = std::min(static_cast<uint32_t>(static_cast<uint8_t>(data[1])), KCP_WSCALE_MAX);
+        opt_recv_ = true;
+
+        if (flags & KCP_OPT_ECHO) // remote has seen our options
+        {
+            opt_echoed_ = true;
+        }
+        // tell remote our options, and that we have seen its own, until
+        // it stops asking. An echo alone is not answered, or it never ends.
+        if (!(flags & KCP_OPT_ECHO) || (flags & KCP_OPT_ANSWER))
+        {
+            probe_ |= KCP_ASK_OPTS;
+        }
+        update_opts();
+    }
+
+    // options are in effect once both sides have seen each other's offer
+    template <typename Config>
+    void BasicKcpp<Config>::update_opts()
+    {
+        if (opt_recv_ && (opt_echoed_ || opt_local_ == 0))
+        {
+            opt_ = opt_local_ & opt_remote_;
+        }
+        else
+        {
+            opt_ = 0;
+        }
+    }
+
+    // move data from rcv_buf to rcv_queue
+    template <typename Config>
+    void BasicKcpp<Config>::mv_buf_to_queue()
+    {
+        while (!rcv_buf_.empty())
+        {
+            auto &slot = rcv_buf_.front();
+            if (!slot.got)
+            {
+                break;
+            }
+
+            if (multistream_) // data has been routed to its stream already
+            {
+            }
+            else if (rcv_queue_.size() < cfg_.rcv_wnd)
+            {
+                deliver(rcv_queue_, rcv_drop_, std::move(slot.seg));
+            }
+            else
+            {
+                break;
+            }
+            rcv_buf_.pop_front();
+            rcv_nxt_++;
+        }
+    }
+
+    // move a segment into its stream, and release the stream in order
+    template <typename Config>
+    void BasicKcpp<Config>::route_stream(kcpSegPtr seg)
+    {
+        if (seg->msg_.header().len < KCP_STREAM_HEAD) // malformed
+        {
+            return;
+        }
+
+        Stream &st = streams_[_stream_id(seg->msg_.data())];
+        uint32_t ssn = _stream_sn(seg->msg_.data());
+
+        if (_itimediff(ssn, st.rcv_nxt) < 0) // delivered already
+        {
+            return;
+        }
+        st.rcv_buf.emplace(ssn, std::move(seg));
+
+        for (auto it = st.rcv_buf.find(st.rcv_nxt); it != st.rcv_buf.end(); it = st.rcv_buf.find(st.rcv_nxt))
+        {
+            nrcv_stream_ += deliver(st.rcv_queue, st.rcv_drop, std::move(it->second));
+            st.rcv_buf.erase(it);
+            st.rcv_nxt++;
+        }
+    }
+
+    // append an in order segment to a receive queue, a skipped segment drops
+    // the rest of its message: fragments queued before it, and those after it
+    // up to the last one. returns the change of the queue size
+    template <typename Config>
+    int BasicKcpp<Config>::deliver(kcpSegList &queue, bool &drop, kcpSegPtr seg)
+    {
+        int count = 0;
+        uint8_t frg = seg->msg_.header().frg;
+
+        if (seg->msg_.header().cmd == KCP_CMD_SKIP)
+        {
+            while (!queue.empty() && queue.back()->msg_.header().frg != 0)
+            {
+                rcv_bytes_ -= queue.back()->msg_.header().len;
+                queue.pop_back();
+                count--;
+            }
+            drop = (frg != 0);
+        }
+        else if (drop)
+        {
+            drop = (frg != 0);
+        }
+        else
+        {
+            rcv_bytes_ += seg->msg_.header().len;
+            queue.push_back(std::move(seg));
+            count++;
+        }
+        return count;
+    }
+
+    // drop expired messages which have not got a sn yet, continuation
+    // fragments of a message already in snd_buf are skipped in flush_data
+    template <typename Config>
+    void BasicKcpp<Config>::drop_expired()
+    {
+        bool start = !snd_msg_open_; // the queue front begins a message
+
+        for (auto it = send_queue_.begin(); it != send_queue_.end() && nsnd_expire_ > 0;)
+        {
+            auto &seg = *it;
+            if (start && seg->expire != 0 && _itimediff(current_, seg->expire) >= 0)
+            {
+                // the whole message
+                uint8_t frg;
+                do
+                {
+                    frg = (*it)->msg_.header().frg;
+                    snd_queued_bytes_ -= (*it)->msg_.header().len;
+                    nsnd_expire_--;
+                    it = send_queue_.erase(it);
+                } while (frg != 0 && it != send_queue_.end());
+                continue;
+            }
+            start = (seg->msg_.header().frg == 0);
+            ++it;
+        }
+    }
+
+    // turn a stale segment into KCP_CMD_SKIP, only the stream header is kept
+    template <typename Config>
+    void BasicKcpp<Config>::expire_seg(kcpSeg &seg)
+    {
+        uint32_t len = multistream_ ? KCP_STREAM_HEAD : 0;
+        snd_flight_bytes_ -= seg.msg_.header().len - len;
+        seg.msg_.header().cmd = KCP_CMD_SKIP;
+        seg.msg_.header().len = len;
+        seg.expire = 0;
+    }
+
+    // segments waiting for recv
+    template <typename Config>
+    uint32_t BasicKcpp<Config>::rcv_queued()
+    {
+        return static_cast<uint32_t>(rcv_queue_.size()) + nrcv_stream_;
+    }
+
+    // move data from snd_queue to snd_buf
+    template <typename Config>
+    void BasicKcpp<Config>::mv_queue_to_buf()
+    {
+        uint32_t cwnd = std::min(cfg_.snd_wnd, rmt_wnd_); // cwnd is the minimum of snd_wnd and rmt_wnd_
+        if (cfg_.nocwnd == false)                         // if nocwnd is false, cwnd is the minimum of cwnd and snd_buf_.size()
+            cwnd = std::min(cwnd_, cwnd);
+
+        // if snd_buf_.size() is less than cwnd, we can send more data
+        while (_itimediff(snd_nxt_, snd_una_ + cwnd) < 0 && !send_queue_.empty())
+        {
+            auto &newseg = send_queue_.front();
+            if (newseg->msg_.header().cmd == KCP_CMD_FILE) // map the next part of the file
+            {
+                if (!load_file())
+                {
+                    send_queue_.pop_front();
+                }
+                continue;
+            }
+            newseg->msg_.header().conv = conv_;
+            newseg->msg_.header().wnd = wnd_adv();
+            newseg->msg_.header().ts = static_cast<uint32_t>(current_);
+            newseg->msg_.header().sn = snd_nxt_++;
+            newseg->msg_.header().una = rcv_nxt_;
+            newseg->resendts = current_;
+            newseg->rto = rx_rto_;
+
+            if (multistream_) // stream sn
+            {
+                uint32_t ssn = streams_[_stream_id(newseg->msg_.data())].snd_nxt++;
+                wire_store32(newseg->msg_.data() + sizeof(uint16_t), ssn);
+            }
+            if (newseg->expire != 0)
+            {
+                nsnd_expire_--;
+            }
+            snd_msg_open_ = (newseg->msg_.header().frg != 0);
+            snd_queued_bytes_ -= newseg->msg_.header().len;
+            snd_flight_bytes_ += newseg->msg_.header().len;
+
+            send_buf_.push_back(std::move(newseg)); // move the data from snd_queue_ to snd_buf_
+            nsnd_buf_++;
+            send_queue_.pop_front();
+        }
+    }
+
+    // flush all acks
+    template <typename Config>
+    char *BasicKcpp<Config>::flush_ack(char *ptr)
+    {
+        kcpSeg seg;
+
+        seg.msg_.header().conv = conv_;
+        seg.msg_.header().cmd = KCP_CMD_ACK;
+        seg.msg_.header().wnd = wnd_adv();
+        seg.msg_.header().una = rcv_nxt_;
+
+        // flush acknowledges
+        for (auto &ack : acklist_)
+        {
+            ptr = try_output(ptr, KCP_OVERHEAD);
+            seg.msg_.header().sn = ack[0];
+            seg.msg_.header().ts = ack[1];
+            ptr = encode_header(ptr, seg);
+        }
+        acklist_.clear();
+        return ptr;
+    }
+
+    // the datagram buffer, allocated by the first segment written after
+    // construction, set_mtu() or compact(), so an idle flush keeps none
+    template <typename Config>
+    char *BasicKcpp<Config>::datagram_buffer()
+    {
+        if (buffer_ == nullptr)
+        {
+            storage_.resize(cfg_.mtu);
+            buffer_ = storage_.data();
+            compacted_ = false;
+        }
+        return buffer_;
+    }
+
+    // if need more bytes does not fit in mtu, send the buffer
+    template <typename Config>
+    char *BasicKcpp<Config>::try_output(char *ptr, int need)
+    {
+        if (buffer_ == nullptr)
+        {
+            return datagram_buffer();
+        }
+        int size = static_cast<int>(ptr - buffer_);
+        if (size + need > static_cast<int>(cfg_.mtu - tail_))
+        {
+            output(buffer_, size);
+            ptr = buffer_;
+        }
+        return ptr;
+    }
+
+    // write the header of seg, compact after the first one of a datagram
+    // once KCP_OPT_COMPACT is negotiated
+    template <typename Config>
+    char *BasicKcpp<Config>::encode_header(char *ptr, kcpSeg &seg)
+    {
+        if ((opt_ & KCP_OPT_COMPACT) == 0)
+        {
+            return seg.copy_header2buf(ptr);
+        }
+
+        if (ptr == buffer_) // full header, flagged
+        {
+            seg.msg_.header().cmd |= KCP_CMD_COMPACT;
+            ptr = seg.copy_header2buf(ptr);
+            seg.msg_.header().cmd &= ~KCP_CMD_COMPACT;
+        }
+        else
+        {
+            ptr = seg.copy_compact_header2buf(ptr, enc_prev_);
+        }
+        enc_prev_ = seg.msg_.header();
+        return ptr;
+    }
+
+    template <typename Config>
+    char *BasicKcpp<Config>::flush_window_probe(char *ptr)
+    {
+        kcpSeg seg;
+
+        seg.msg_.header().conv = conv_;
+        seg.msg_.header().cmd = KCP_CMD_ACK;
+        seg.msg_.header().wnd = wnd_adv();
+        seg.msg_.header().una = rcv_nxt_;
+
+        // flush window probing commands
+        if (probe_ & (KCP_ASK_SEND | KCP_ASK_TELL))
+        {
+            KCP_TRACE(KCP_TRACE_PROBE, 0, probe_);
+        }
+        if (probe_ & KCP_ASK_SEND)
+        {
+            seg.msg_.header().cmd = KCP_CMD_WASK;
+            ptr = try_output(ptr, KCP_OVERHEAD);
+            ptr = encode_header(ptr, seg);
+        }
+
+        // flush window probing commands
+        if (probe_ & KCP_ASK_TELL)
+        {
+            seg.msg_.header().cmd = KCP_CMD_WINS;
+            ptr = try_output(ptr, KCP_OVERHEAD);
+            ptr = encode_header(ptr, seg);
+        }
+
+        // offer options until the remote echoes them
+        if (opt_local_ != 0 && !opt_echoed_ && _itimediff(current_, ts_opts_) >= 0)
+        {
+            ts_opts_ = current_ + rx_rto_;
+            probe_ |= KCP_ASK_OPTS;
+        }
+
+        // flush option negotiation, alone in a datagram so that a remote
+        // which does not know KCP_CMD_OPTS only drops this one
+        if (probe_ & KCP_ASK_OPTS)
+        {
+            int size = static_cast<int>(ptr - buffer_);
+            if (size > 0)
+            {
+                output(buffer_, size);
+            }
+            seg.msg_.header().cmd = KCP_CMD_OPTS;
+            seg.msg_.header().len = KCP_OPTS_LEN;
+            ptr = seg.copy_header2buf(datagram_buffer());
+            uint8_t flags = opt_local_ | (opt_recv_ ? KCP_OPT_ECHO : 0);
+            if (opt_local_ != 0 && !opt_echoed_)
+            {
+                flags |= KCP_OPT_ANSWER;
+            }
+            *ptr++ = static_cast<char>(flags);
+            *ptr++ = static_cast<char>(wscale_);
+            output(buffer_, static_cast<int>(ptr - buffer_));
+            ptr = buffer_;
+        }
+
+        probe_ = 0;
+        return ptr;
+    }
+
+    // flush data
+    template <typename Config>
+    char *BasicKcpp<Config>::flush_data(char *ptr)
+    {
+        bool change = false, lost = false;
+
+        kcpSeg seg;
+        seg.msg_.header().conv = conv_;
+        seg.msg_.header().cmd = KCP_CMD_ACK;
+        seg.msg_.header().wnd = wnd_adv();
+        seg.msg_.header().una = rcv_nxt_;
+
+        uint32_t resent = (fastresend_ > 0) ? static_cast<uint32_t>(fastresend_) : std::numeric_limits<uint32_t>::max();
+        uint32_t rtomin = (cfg_.nodelay == 0) ? (rx_rto_ >> 3) : 0;
+
+        for (auto &segment : send_buf_)
+        {
+            if (!segment) // acked
+                continue;
+
+            bool needsend = false;
+            if (segment->expire != 0 && _itimediff(current_, segment->expire) >= 0) // stale, skip instead
+            {
+                expire_seg(*segment);
+                needsend = true;
+                segment->xmit++;
+                segment->rto = rx_rto_;
+                segment->resendts = current_ + segment->rto;
+            }
+            else if (segment->xmit == 0) // first time to send
+            {
+                needsend = true;
+                segment->xmit++;
+                KCP_TRACE(KCP_TRACE_SEND, segment->msg_.header().sn, segment->msg_.header().len);
+                segment->rto = rx_rto_;
+                segment->resendts = current_ + segment->rto + rtomin; // resend time
+            }
+            else if (current_ >= segment->resendts) // resend
+            {
+                needsend = true;
+                segment->xmit++;
+                xmit_++;
+                KCP_COUNT(rto_expired, 1);
+                KCP_TRACE(KCP_TRACE_RESEND, segment->msg_.header().sn, segment->xmit);
+                if (cfg_.nodelay == 0)
+                {
+                    segment->rto += std::max(segment->rto, static_cast<uint32_t>(rx_rto_));
+                }
+                else
+                {
+                    segment->rto += rx_rto_;
+                }
+                segment->resendts = current_ + segment->rto;
+                lost = true; // lost
+            }
+            else if (segment->fastack >= resent) // fast resend
+            {
+                needsend = true;
+                segment->xmit++;
+                segment->fastack = 0;
+                segment->resendts = current_ + segment->rto;
+                change = true;
+                KCP_COUNT(fast_retrans, 1);
+                KCP_TRACE(KCP_TRACE_FASTRESEND, segment->msg_.header().sn, segment->xmit);
+            }
+
+            if (needsend)
+            {
+                segment->msg_.header().ts = static_cast<uint32_t>(current_);
+                if (segment->xmit == 2)
+                {
+                    segment->ts_resent = segment->msg_.header().ts;
+                }
+                segment->msg_.header().wnd = seg.msg_.header().wnd;
+                segment->msg_.header().una = rcv_nxt_;
+
+                ptr = try_output(ptr, KCP_OVERHEAD + segment->msg_.header().len);
+
+                ptr = encode_header(ptr, *segment);
+                ptr = segment->copy_data2buf(ptr);
+
+                KCP_COUNT(segs_sent, 1);
+                KCP_COUNT(bytes_sent, segment->msg_.header().len);
+                if (segment->xmit > 1)
+                {
+                    KCP_COUNT(segs_retrans, 1);
+                    KCP_COUNT(bytes_retrans, segment->msg_.header().len);
+                }
+
+                if (segment->xmit >= dead_link_)
+                {
+                    state_ = false;
+                }
+            }
+        }
+
+        // remember the state before the first reduction of this loss episode
+        if ((change || lost) && undo_ && !undo_pending_)
+        {
+            undo_cwnd_ = cwnd_;
+            undo_ssthresh_ = ssthresh_;
+            undo_incr_ = incr_;
+            undo_recover_ = snd_nxt_;
+            undo_pending_ = true;
+        }
+
+        if (change)
+        {
+            uint32_t inflight = snd_nxt_ - snd_una_;
+            ssthresh_ = std::max(inflight / 2, KCP_THRESH_MIN);
+            cwnd_ = ssthresh_ + resent;
+            incr_ = cwnd_ * mss_;
+        }
+
+        if (lost)
+        {
+            ssthresh_ = std::max(cwnd_ / 2, KCP_THRESH_MIN);
+            cwnd_ = 1;
+            incr_ = mss_;
+        }
+        if (cwnd_ < 1)
+        {
+            cwnd_ = 1;
+            incr_ = mss_;
+        }
+        trace_cwnd();
+        return ptr;
+    }
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include "lz.h"
+
+#include <climits>
+#include <cstring>
+
+using namespace stone;
+
+namespace
+{
+    const int LZ_MINMATCH = 4;
+    const int LZ_LASTLITERALS = 5;  // the block always ends with literals
+    const int LZ_MFLIMIT = 12;      // no match starts in the last 12 bytes
+    const int LZ_HASH_BITS = 12;
+    const int LZ_MAX_OFFSET = 65535;
+    const int LZ_SKIP_TRIGGER = 6;  // search faster while nothing matches
+
+    inline uint32_t read32(const uint8_t *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    inline uint32_t hash32(uint32_t seq)
+    {
+        return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+    // 15 in the token nibble, then bytes of 255 and the rest
+    inline uint8_t *write_length(uint8_t *op, int len)
+    {
+        for (len -= 15; len >= 255; len -= 255)
+        {
+            *op++ = 255;
+        }
+        *op++ = static_cast<uint8_t>(len);
+        return op;
+    }
+
+    inline bool read_length(const uint8_t *&ip, const uint8_t *iend, int &len)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip >= iend)
+                return false;
+            byte = *ip++;
+            len += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+int stone::lz_compress_bound(int len)
+{
+    return len + len / 255 + 16;
+}
+
+// a length byte adds at most 255 bytes to a match, nothing expands more
+int stone::lz_decompress_bound(int len)
+{
+    int64_t bound = static_cast<int64_t>(len) * 255;
+    return bound > INT_MAX ? INT_MAX : static_cast<int>(bound);
+}
+
+int stone::lz_compress(const char *src, int len, char *dst, int capacity)
+{
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *iend = base + len;
+    uint8_t *op = reinterpret_cast<uint8_t *>(dst);
+    uint8_t *oend = op + capacity;
+
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    if (len >= LZ_MFLIMIT)
+    {
+        const uint8_t *mflimit = iend - LZ_MFLIMIT;
+        const uint8_t *matchlimit = iend - LZ_LASTLITERALS;
+        uint32_t search = 1 << LZ_SKIP_TRIGGER;
+        while (ip < mflimit)
+        {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash32(seq);
+            const uint8_t *ref = base + table[h];
+            table[h] = static_cast<uint32_t>(ip - base);
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET || read32(ref) != seq)
+            {
+                ip += search++ >> LZ_SKIP_TRIGGER;
+                continue;
+            }
+
+            // extend the match both ways
+            while (ip > anchor && ref > base && ip[-1] == ref[-1])
+            {
+                ip--;
+                ref--;
+            }
+            const uint8_t *mp = ip + LZ_MINMATCH;
+            const uint8_t *rp = ref + LZ_MINMATCH;
+            while (mp < matchlimit && *mp == *rp)
+            {
+                mp++;
+                rp++;
+            }
+
+            int litlen = static_cast<int>(ip - anchor);
+            int mlen = static_cast<int>(mp - ip) - LZ_MINMATCH;
+            if (oend - op < 1 + litlen + litlen / 255 + 1 + 2 + mlen / 255 + 1)
+            {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            *token = static_cast<uint8_t>(((litlen < 15 ? litlen : 15) << 4) | (mlen < 15 ? mlen : 15));
+            if (litlen >= 15)
+                op = write_length(op, litlen);
+            memcpy(op, anchor, litlen);
+            op += litlen;
+
+            uint16_t offset = static_cast<uint16_t>(ip - ref);
+            *op++ = static_cast<uint8_t>(offset);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            if (mlen >= 15)
+                op = write_length(op, mlen);
+
+            ip = mp;
+            anchor = ip;
+            search = 1 << LZ_SKIP_TRIGGER;
+            if (ip < mflimit)
+            {
+                table[hash32(read32(ip - 2))] = static_cast<uint32_t>(ip - 2 - base);
+            }
+        }
+    }
+
+    // last literals
+    int litlen = static_cast<int>(iend - anchor);
+    if (oend - op < 1 + litlen + litlen / 255 + 1)
+    {
+        return 0;
+    }
+    *op++ = static_cast<uint8_t>((litlen < 15 ? litlen : 15) << 4);
+    if (litlen >= 15)
+        op = write_length(op, litlen);
+    if (litlen > 0)
+        memcpy(op, anchor, litlen);
+    op += litlen;
+
+    return static_cast<int>(op - reinterpret_cast<uint8_t *>(dst));
+}
+
+int stone::lz_decompress(const char *src, int len, char *dst, int capacity)
+{
+    const uint8_t *ip = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *iend = ip + len;
+    uint8_t *base = reinterpret_cast<uint8_t *>(dst);
+    uint8_t *op = base;
+    uint8_t *oend = base + capacity;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        int litlen = token >> 4;
+        if (litlen == 15 && !read_length(ip, iend, litlen))
+            return -1;
+        if (litlen > iend - ip || litlen > oend - op)
+            return -1;
+        memcpy(op, ip, litlen);
+        ip += litlen;
+        op += litlen;
+
+        if (ip == iend) // last literals
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - base)
+            return -1;
+
+        int mlen = token & 15;
+        if (mlen == 15 && !read_length(ip, iend, mlen))
+            return -1;
+        mlen += LZ_MINMATCH;
+        if (mlen > oend - op)
+            return -1;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= mlen)
+        {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        }
+        else // overlapping, repeat the pattern
+        {
+            for (int i = 0; i < mlen; i++)
+            {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return static_cast<int>(op - base);
+}
@@ -0,0 +1,26 @@
+#ifndef STONE_LZ_H
+#define STONE_LZ_H
+#include <cstdint>
+
+namespace stone
+{
+    // LZ4 style block codec: tokens of literal run + (offset, match length),
+    // 64K window, no entropy stage.
+
+    // worst case size of lz_compress output for len bytes
+    int lz_compress_bound(int len);
+
+    // compress src into dst, returns the compressed size, or 0 if it does
+    // not fit in capacity (the caller sends the data raw then)
+    int lz_compress(const char *src, int len, char *dst, int capacity);
+
+    // most that len bytes can decompress to, to reject bogus sizes before
+    // allocating for them
+    int lz_decompress_bound(int len);
+
+    // returns the decompressed size, or -1 if src is malformed or the
+    // output does not fit in capacity
+    int lz_decompress(const char *src, int len, char *dst, int capacity);
+}
+
+#endif
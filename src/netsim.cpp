@@ -0,0 +1,168 @@
+#include "netsim.h"
+
+#include <algorithm>
+
+using namespace stone;
+
+NetSim::NetSim(uint64_t seed) : rng_(seed), now_us_(0), seq_(0), started_(false), stopped_(false)
+{
+}
+
+void NetSim::at(uint32_t ms, std::function<void()> fn)
+{
+    Event event;
+    event.fn = std::move(fn);
+    events_.emplace(std::make_pair(static_cast<uint64_t>(ms) * 1000, seq_++), std::move(event));
+}
+
+// uniform in [0, 1), not std::uniform_real_distribution whose output
+// differs between standard libraries
+bool NetSim::chance(double p)
+{
+    if (p <= 0)
+        return false;
+    return static_cast<double>(rng_() >> 11) * (1.0 / 9007199254740992.0) < p;
+}
+
+uint64_t NetSim::delay_us(const NetSimLink &config)
+{
+    uint64_t delay = static_cast<uint64_t>(config.delay_min) * 1000;
+    if (config.delay_max > config.delay_min)
+    {
+        delay += rng_() % (static_cast<uint64_t>(config.delay_max - config.delay_min) * 1000);
+    }
+    return delay;
+}
+
+void NetSim::transmit(int from, const char *buf, int len)
+{
+    Link &link = links_[from];
+    const NetSimLink &config = link.config;
+    link.stats.sent++;
+
+    link.bad = link.bad ? !chance(config.bad_to_good) : chance(config.good_to_bad);
+    if (chance(link.bad ? config.loss_bad : config.loss_good))
+    {
+        link.stats.lost++;
+        return;
+    }
+
+    // wait behind the datagrams still being serialized
+    uint64_t departure = now_us_;
+    if (config.bandwidth > 0)
+    {
+        while (!link.departures.empty() && link.departures.front() <= now_us_)
+        {
+            link.departures.pop_front();
+        }
+        if (config.queue > 0 && link.departures.size() >= config.queue)
+        {
+            link.stats.overflow++;
+            return;
+        }
+        departure = std::max(now_us_, link.wire_free_us) + static_cast<uint64_t>(len) * 1000000 / config.bandwidth;
+        link.wire_free_us = departure;
+        link.departures.push_back(departure);
+    }
+
+    int copies = chance(config.duplicate) ? 2 : 1;
+    link.stats.duplicated += copies - 1;
+    for (int i = 0; i < copies; i++)
+    {
+        uint64_t arrival = departure + delay_us(config);
+        if (chance(config.reorder))
+        {
+            link.stats.reordered++;
+        }
+        else
+        {
+            arrival = std::max(arrival, link.last_arrival_us);
+            link.last_arrival_us = arrival;
+        }
+        Event event;
+        event.to = from ^ 1;
+        event.data.assign(buf, len);
+        events_.emplace(std::make_pair(arrival, seq_++), std::move(event));
+    }
+}
+
+void NetSim::schedule_update(Node &node)
+{
+    uint32_t now = this->now();
+    uint32_t next = node.check(now);
+    if (static_cast<int32_t>(next - now) < 0)
+    {
+        next = now;
+    }
+    // at most one update per ms, as a real clock would allow
+    if (static_cast<int64_t>(next) <= node.updated_ms)
+    {
+        next = static_cast<uint32_t>(node.updated_ms + 1);
+    }
+    node.next_us = static_cast<uint64_t>(next) * 1000;
+}
+
+void NetSim::run(uint32_t ms)
+{
+    uint64_t end = static_cast<uint64_t>(ms) * 1000;
+    stopped_ = false;
+    if (!started_)
+    {
+        started_ = true;
+        for (Node &node : nodes_)
+        {
+            node.update(now());
+            node.updated_ms = now();
+        }
+    }
+
+    while (!stopped_)
+    {
+        for (Node &node : nodes_)
+        {
+            schedule_update(node);
+        }
+        uint64_t next = std::min(nodes_[0].next_us, nodes_[1].next_us);
+        if (!events_.empty())
+        {
+            next = std::min(next, events_.begin()->first.first);
+        }
+        if (next > end)
+        {
+            break;
+        }
+        now_us_ = std::max(now_us_, next);
+
+        while (!events_.empty() && events_.begin()->first.first <= now_us_)
+        {
+            Event event = std::move(events_.begin()->second);
+            events_.erase(events_.begin());
+            if (event.to >= 0)
+            {
+                links_[event.to ^ 1].stats.delivered++;
+                nodes_[event.to].input(event.data.data(), static_cast<uint32_t>(event.data.size()));
+            }
+            else
+            {
+                event.fn();
+            }
+        }
+        for (Node &node : nodes_)
+        {
+            if (node.next_us <= now_us_)
+            {
+                node.update(now());
+                node.updated_ms = now();
+            }
+        }
+        if (poll_)
+        {
+            poll_();
+        }
+    }
+
+    if (!stopped_)
+    {
+        now_us_ = std::max(now_us_, end);
+    }
+}
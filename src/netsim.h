@@ -0,0 +1,132 @@
+#ifndef STONE_NETSIM_H
+#define STONE_NETSIM_H
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+
+namespace stone
+{
+    // One direction of a simulated path. Each datagram is first put
+    // through the Gilbert-Elliott loss chain, then waits for the wire
+    // behind the earlier ones, then takes a random propagation delay.
+    struct NetSimLink
+    {
+        uint32_t delay_min = 30, delay_max = 60; // one way, ms
+        uint64_t bandwidth = 0;                  // bytes per second, 0 for unlimited
+        uint32_t queue = 0;                      // datagrams waiting for the wire, 0 for unlimited
+        double reorder = 0;                      // chance to arrive regardless of the ones before
+        double duplicate = 0;                    // chance to arrive twice
+        // Gilbert-Elliott: loss chance in the good and the bad state, and
+        // the chance of switching state before each datagram. The defaults
+        // never leave the good state, loss_good alone is uniform loss.
+        double loss_good = 0, loss_bad = 1;
+        double good_to_bad = 0, bad_to_good = 1;
+    };
+
+    struct NetSimStats
+    {
+        uint64_t sent = 0, delivered = 0;
+        uint64_t lost = 0;     // by the loss chain
+        uint64_t overflow = 0; // the queue was full
+        uint64_t duplicated = 0, reordered = 0;
+    };
+
+    // Deterministic network simulator on a virtual clock. Two sessions are
+    // joined by two links, and run() jumps from one event to the next:
+    // a datagram arriving, a timer set with at(), or the time check()
+    // asks to be updated at. Nothing sleeps, so a seed always gives the
+    // same run and simulated minutes take milliseconds.
+    //
+    //     NetSim sim(seed);
+    //     sim.attach(kcp1, kcp2, link, link);
+    //     sim.at(0, [&] { kcp1.send(data, len); });
+    //     sim.set_poll([&] { while (kcp2.recv(buf, sizeof(buf)) > 0) ...; });
+    //     sim.run(60000);
+    class NetSim
+    {
+    public:
+        explicit NetSim(uint64_t seed);
+
+        // take over the output callbacks, a to b uses ab
+        template <typename K>
+        void attach(K &a, K &b, const NetSimLink &ab, const NetSimLink &ba)
+        {
+            K *kcps[2] = {&a, &b};
+            for (int i = 0; i < 2; i++)
+            {
+                K *kcp = kcps[i];
+                nodes_[i].input = [kcp](const char *data, uint32_t size) { kcp->input(data, size); };
+                nodes_[i].update = [kcp](uint32_t current) { kcp->update(current); };
+                nodes_[i].check = [kcp](uint32_t current) { return static_cast<uint32_t>(kcp->check(current)); };
+                kcp->set_output([this, i](const char *buf, int len, K *, void *) {
+                    transmit(i, buf, len);
+                    return len;
+                });
+            }
+            links_[0].config = ab;
+            links_[1].config = ba;
+        }
+
+        // call fn once the clock reaches ms, timers may add timers
+        void at(uint32_t ms, std::function<void()> fn);
+        // called after every step, where the application reads and writes
+        void set_poll(std::function<void()> fn) { poll_ = std::move(fn); }
+
+        // advance the clock to ms, or until stop()
+        void run(uint32_t ms);
+        void stop() { stopped_ = true; }
+
+        uint32_t now() const { return static_cast<uint32_t>(now_us_ / 1000); }
+        uint64_t now_us() const { return now_us_; }
+        // 0 is a to b
+        const NetSimStats &stats(int direction) const { return links_[direction].stats; }
+
+    private:
+        struct Node
+        {
+            std::function<void(const char *, uint32_t)> input;
+            std::function<void(uint32_t)> update;
+            std::function<uint32_t(uint32_t)> check;
+            uint64_t next_us = 0;      // when check() wants an update
+            int64_t updated_ms = -1;   // last update() time
+        };
+
+        struct Link
+        {
+            NetSimLink config;
+            NetSimStats stats;
+            bool bad = false;
+            uint64_t wire_free_us = 0;      // end of the last serialization
+            uint64_t last_arrival_us = 0;   // FIFO order for datagrams not reordered
+            std::deque<uint64_t> departures; // of datagrams still queued
+        };
+
+        struct Event
+        {
+            int to = -1; // node receiving data, -1 for a timer
+            std::string data;
+            std::function<void()> fn;
+        };
+
+        void transmit(int from, const char *buf, int len);
+        void schedule_update(Node &node);
+        bool chance(double p);
+        uint64_t delay_us(const NetSimLink &config);
+
+    private:
+        std::mt19937_64 rng_;
+        uint64_t now_us_;
+        uint64_t seq_; // breaks ties between events at the same time
+        bool started_, stopped_;
+        Node nodes_[2];
+        Link links_[2];
+        std::map<std::pair<uint64_t, uint64_t>, Event> events_;
+        std::function<void()> poll_;
+    };
+}
+
+#endif
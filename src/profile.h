@@ -0,0 +1,91 @@
+#ifndef STONE_PROFILE_H
+#define STONE_PROFILE_H
+#include <chrono>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
+
+namespace stone
+{
+    // Per-phase cost of flush() and input(), compiled in with KCP_PROFILE.
+    // Ticks are TSC cycles on x86, nanoseconds elsewhere.
+
+    enum KcpPhase
+    {
+        KCP_PHASE_FLUSH_ACK,    // rcv window tuning and acks
+        KCP_PHASE_UPDATE_PROBE, // deciding to ask for the remote window
+        KCP_PHASE_WINDOW_PROBE, // WASK/WINS out
+        KCP_PHASE_MV_QUEUE,     // expiry and snd_queue to snd_buf
+        KCP_PHASE_FLUSH_DATA,   // data segments, resends, cwnd
+        KCP_PHASE_FLUSH_TAIL,   // last datagram out, watermarks, compaction
+        KCP_PHASE_INPUT_AUTH,   // checksum and cipher
+        KCP_PHASE_INPUT_PARSE,  // segment loop
+        KCP_PHASE_INPUT_ACK,    // fastack and cwnd growth
+        KCP_PHASE_COUNT,
+    };
+
+    const uint32_t KCP_PROFILE_BUCKETS = 32; // bucket i: ticks in [2^i, 2^(i+1)), 0 in bucket 0
+
+    struct KcpPhaseProfile
+    {
+        uint64_t calls = 0;
+        uint64_t ticks = 0;
+        uint64_t buckets[KCP_PROFILE_BUCKETS] = {};
+
+        void record(uint64_t elapsed)
+        {
+            calls++;
+            ticks += elapsed;
+            uint32_t bucket = 0;
+#if defined(__GNUC__)
+            bucket = elapsed > 1 ? 63 - __builtin_clzll(elapsed) : 0;
+#else
+            for (uint64_t v = elapsed; v > 1; v >>= 1)
+                bucket++;
+#endif
+            buckets[bucket < KCP_PROFILE_BUCKETS ? bucket : KCP_PROFILE_BUCKETS - 1]++;
+        }
+    };
+
+    struct KcpProfile
+    {
+        KcpPhaseProfile phases[KCP_PHASE_COUNT];
+
+        // sum sessions into one process view
+        KcpProfile &operator+=(const KcpProfile &other)
+        {
+            for (int p = 0; p < KCP_PHASE_COUNT; p++)
+            {
+                phases[p].calls += other.phases[p].calls;
+                phases[p].ticks += other.phases[p].ticks;
+                for (uint32_t b = 0; b < KCP_PROFILE_BUCKETS; b++)
+                    phases[p].buckets[b] += other.phases[p].buckets[b];
+            }
+            return *this;
+        }
+    };
+
+    inline uint64_t kcp_ticks()
+    {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+#endif
+    }
+
+    inline const char *kcp_phase_name(int phase)
+    {
+        static const char *const names[KCP_PHASE_COUNT] = {
+            "flush_ack",  "update_probe", "window_probe", "mv_queue",  "flush_data",
+            "flush_tail", "input_auth",   "input_parse",  "input_ack",
+        };
+        return phase >= 0 && phase < KCP_PHASE_COUNT ? names[phase] : "unknown";
+    }
+}
+
+#endif
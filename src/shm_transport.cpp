@@ -0,0 +1,341 @@
+#include "shm_transport.h"
+
+#include <climits>
+#include <cstring>
+#include <thread>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+using namespace stone;
+
+namespace
+{
+    const uint32_t SHM_MAGIC = 0x4b435053;  // "SPCK"
+    const uint32_t SHM_WRAP = 0xffffffff;   // record length: skip to the start of the ring
+    const uint32_t SHM_RECORD_HEAD = 4;     // record: length, then the datagram
+    const int SHM_SPIN = 2000;              // polls before sleeping, with more than one cpu
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "the rings need address free atomics");
+
+    struct Segment
+    {
+        std::atomic<uint32_t> magic; // set once the rings are initialized
+        ShmTransport::Ring rings[2]; // [0] creator to attacher, [1] the other way
+    };
+
+    inline uint32_t record_size(uint32_t len)
+    {
+        return (SHM_RECORD_HEAD + len + 7) & ~7u;
+    }
+
+    inline uint32_t round_pow2(uint32_t n)
+    {
+        uint32_t p = 64;
+        while (p < n)
+        {
+            p <<= 1;
+        }
+        return p;
+    }
+
+#if defined(__linux__)
+    void futex_wake(std::atomic<uint32_t> *word)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    void futex_wait(std::atomic<uint32_t> *word, uint32_t expect, int64_t timeout_us)
+    {
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(timeout_us / 1000000);
+        ts.tv_nsec = static_cast<long>(timeout_us % 1000000) * 1000;
+        syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), FUTEX_WAIT, expect, &ts, nullptr, 0);
+    }
+#endif
+
+    inline bool ring_empty(const ShmTransport::Ring &ring)
+    {
+        return ring.head.load(std::memory_order_relaxed) == ring.tail.load(std::memory_order_acquire);
+    }
+}
+
+ShmTransport::ShmTransport()
+    : base_(nullptr), size_(0), tx_(nullptr), rx_(nullptr), tx_data_(nullptr), rx_data_(nullptr), capacity_(0),
+      owner_(false), broken_(false)
+{
+}
+
+ShmTransport::~ShmTransport()
+{
+    close();
+}
+
+bool ShmTransport::create(const std::string &name, uint32_t capacity)
+{
+#if defined(__linux__)
+    close();
+    capacity = round_pow2(capacity);
+    size_t size = sizeof(Segment) + static_cast<size_t>(capacity) * 2;
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(fd, size, true, capacity))
+    {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    ::close(fd);
+    name_ = name;
+    owner_ = true;
+    return true;
+#else
+    (void)name;
+    (void)capacity;
+    return false;
+#endif
+}
+
+bool ShmTransport::attach(const std::string &name)
+{
+#if defined(__linux__)
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Segment) ||
+        !map(fd, static_cast<size_t>(st.st_size), false, 0))
+    {
+        ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    name_ = name;
+    owner_ = false;
+    return true;
+#else
+    (void)name;
+    return false;
+#endif
+}
+
+bool ShmTransport::map(int fd, size_t size, bool init, uint32_t capacity)
+{
+#if defined(__linux__)
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        return false;
+    }
+    Segment *seg = static_cast<Segment *>(addr);
+
+    if (init) // fresh pages are zero, only the sizes need to be set
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            seg->rings[i].capacity = capacity;
+            seg->rings[i].offset = static_cast<uint32_t>(sizeof(Segment) + static_cast<size_t>(capacity) * i);
+        }
+        seg->magic.store(SHM_MAGIC, std::memory_order_release);
+    }
+    else
+    {
+        // not ready or foreign: the rings must be the ones create() lays out
+        capacity = seg->rings[0].capacity;
+        bool valid = seg->magic.load(std::memory_order_acquire) == SHM_MAGIC && capacity >= 64 &&
+                     (capacity & (capacity - 1)) == 0 && sizeof(Segment) + static_cast<size_t>(capacity) * 2 == size;
+        for (int i = 0; valid && i < 2; i++)
+        {
+            valid = seg->rings[i].capacity == capacity &&
+                    seg->rings[i].offset == sizeof(Segment) + static_cast<size_t>(capacity) * i;
+        }
+        if (!valid)
+        {
+            munmap(addr, size);
+            return false;
+        }
+    }
+
+    base_ = static_cast<char *>(addr);
+    size_ = size;
+    tx_ = &seg->rings[init ? 0 : 1];
+    rx_ = &seg->rings[init ? 1 : 0];
+    tx_data_ = base_ + tx_->offset;
+    rx_data_ = base_ + rx_->offset;
+    capacity_ = capacity;
+    broken_ = false;
+    return true;
+#else
+    (void)fd;
+    (void)size;
+    (void)init;
+    (void)capacity;
+    return false;
+#endif
+}
+
+void ShmTransport::close()
+{
+#if defined(__linux__)
+    if (base_ == nullptr)
+    {
+        return;
+    }
+    munmap(base_, size_);
+    if (owner_)
+    {
+        shm_unlink(name_.c_str());
+    }
+    base_ = nullptr;
+    tx_ = rx_ = nullptr;
+    tx_data_ = rx_data_ = nullptr;
+    owner_ = false;
+#endif
+}
+
+int ShmTransport::send(const char *data, int len)
+{
+    if (tx_ == nullptr || len < 0)
+    {
+        return -1;
+    }
+    Ring &ring = *tx_;
+    uint32_t capacity = capacity_;
+    uint32_t need = record_size(static_cast<uint32_t>(len));
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t head = ring.head.load(std::memory_order_acquire);
+
+    // a record never wraps, the rest of the ring is skipped instead
+    uint32_t offset = static_cast<uint32_t>(tail & (capacity - 1));
+    uint32_t skip = capacity - offset < need ? capacity - offset : 0;
+    if (need > capacity || tail + skip + need - head > capacity) // full, dropped like on a socket
+    {
+        return -1;
+    }
+    if (skip > 0)
+    {
+        memcpy(tx_data_ + offset, &SHM_WRAP, sizeof(SHM_WRAP));
+        offset = 0;
+    }
+    uint32_t size = static_cast<uint32_t>(len);
+    memcpy(tx_data_ + offset, &size, sizeof(size));
+    memcpy(tx_data_ + offset + SHM_RECORD_HEAD, data, size);
+    ring.tail.store(tail + skip + need, std::memory_order_release);
+
+    // a consumer going to sleep either sees the new signal or is counted
+    ring.signal.fetch_add(1, std::memory_order_seq_cst);
+#if defined(__linux__)
+    if (ring.sleepers.load(std::memory_order_seq_cst) > 0)
+    {
+        futex_wake(&ring.signal);
+    }
+#endif
+    return len;
+}
+
+int ShmTransport::recv(char *buffer, int len)
+{
+    if (rx_ == nullptr)
+    {
+        return -1;
+    }
+    if (broken_)
+    {
+        return -3;
+    }
+    Ring &ring = *rx_;
+    uint32_t capacity = capacity_;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t tail = ring.tail.load(std::memory_order_acquire);
+
+    // everything comes from the peer's side of the ring, a record must lie
+    // within the ring and within what was published
+    while (head != tail)
+    {
+        uint32_t offset = static_cast<uint32_t>(head & (capacity - 1));
+        uint64_t available = tail - head;
+        if (available > capacity || offset % 8 != 0)
+        {
+            broken_ = true;
+            return -3;
+        }
+        uint32_t size;
+        memcpy(&size, rx_data_ + offset, sizeof(size));
+        if (size == SHM_WRAP)
+        {
+            if (available < capacity - offset)
+            {
+                broken_ = true;
+                return -3;
+            }
+            head += capacity - offset;
+            continue;
+        }
+        if (size > capacity - offset - SHM_RECORD_HEAD || record_size(size) > available)
+        {
+            broken_ = true;
+            return -3;
+        }
+
+        int result = -2;
+        if (static_cast<int>(size) <= len)
+        {
+            memcpy(buffer, rx_data_ + offset + SHM_RECORD_HEAD, size);
+            result = static_cast<int>(size);
+        }
+        ring.head.store(head + record_size(size), std::memory_order_release);
+        return result;
+    }
+    ring.head.store(head, std::memory_order_release);
+    return -1;
+}
+
+bool ShmTransport::wait(int64_t timeout_us)
+{
+    if (rx_ == nullptr || broken_)
+    {
+        return false;
+    }
+    Ring &ring = *rx_;
+
+    // a short spin is cheaper than a futex round trip, if the peer can
+    // run meanwhile
+    static const bool spin = std::thread::hardware_concurrency() > 1;
+    for (int i = 0; spin && i < SHM_SPIN; i++)
+    {
+        if (!ring_empty(ring))
+            return true;
+    }
+
+#if defined(__linux__)
+    uint32_t signal = ring.signal.load(std::memory_order_seq_cst);
+    if (!ring_empty(ring))
+    {
+        return true;
+    }
+    ring.sleepers.fetch_add(1, std::memory_order_seq_cst);
+    if (timeout_us > 0 && ring_empty(ring))
+    {
+        futex_wait(&ring.signal, signal, timeout_us);
+    }
+    ring.sleepers.fetch_sub(1, std::memory_order_seq_cst);
+#else
+    (void)timeout_us;
+#endif
+    return !ring_empty(ring);
+}
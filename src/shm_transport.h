@@ -0,0 +1,97 @@
+#ifndef STONE_SHM_TRANSPORT_H
+#define STONE_SHM_TRANSPORT_H
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace stone
+{
+    // Datagram transport between two processes on the same host: two
+    // single-producer single-consumer rings in a POSIX shared memory
+    // segment, one per direction, with futex wakeups. Like UDP, a datagram
+    // that does not fit in the ring is dropped and left to KCP to resend.
+    //
+    //     ShmTransport shm;
+    //     shm.create("/game-42", 1 << 20);  // the other side: shm.attach("/game-42")
+    //     kcp.set_output([&](const char *buf, int len, Kcpp *, void *) { return shm.send(buf, len); });
+    //     ...
+    //     shm.wait(timeout_us);
+    //     shm.drain(kcp);
+    //
+    // Linux only, elsewhere create() and attach() fail.
+    class ShmTransport
+    {
+    public:
+        ShmTransport();
+        ~ShmTransport();
+
+        ShmTransport(const ShmTransport &) = delete;
+        ShmTransport &operator=(const ShmTransport &) = delete;
+
+        // create the segment with capacity bytes per direction (rounded up
+        // to a power of two), the name is removed again on close()
+        bool create(const std::string &name, uint32_t capacity);
+        // open a segment made by create() in another process
+        bool attach(const std::string &name);
+        void close();
+
+        // queue a datagram for the peer, returns len, or -1 if the ring is full
+        int send(const char *data, int len);
+        // take the next datagram, returns its size, -1 if there is none,
+        // -2 if buffer is too small (the datagram is dropped), -3 once the
+        // ring holds a record that cannot be there
+        int recv(char *buffer, int len);
+        // sleep until a datagram is available or timeout_us has passed,
+        // returns false on timeout or once broken
+        bool wait(int64_t timeout_us);
+        // the peer wrote past its ring or a bad record length, nothing
+        // more is read, close() and set up a new segment
+        bool broken() const
+        {
+            return broken_;
+        }
+
+        // feed every pending datagram to kcp.input(), returns how many
+        template <typename K>
+        int drain(K &kcp)
+        {
+            int count = 0;
+            int size;
+            while ((size = recv(buffer_, sizeof(buffer_))) != -1 && size != -3)
+            {
+                if (size >= 0)
+                {
+                    kcp.input(buffer_, static_cast<uint32_t>(size));
+                    count++;
+                }
+            }
+            return count;
+        }
+
+        // one direction of the segment
+        struct Ring
+        {
+            alignas(64) std::atomic<uint64_t> head; // next byte to read, consumer owned
+            alignas(64) std::atomic<uint64_t> tail; // next byte to write, producer owned
+            alignas(64) std::atomic<uint32_t> signal;   // futex word, bumped on every send
+            std::atomic<uint32_t> sleepers;             // consumers waiting on signal
+            uint32_t capacity;
+            uint32_t offset; // of the data from the start of the segment
+        };
+
+    private:
+        bool map(int fd, size_t size, bool init, uint32_t capacity);
+
+    private:
+        std::string name_;
+        char *base_;
+        size_t size_;
+        Ring *tx_, *rx_;
+        char *tx_data_, *rx_data_;
+        uint32_t capacity_; // of both rings, as mapped, the peer cannot change it
+        bool owner_, broken_;
+        char buffer_[64 * 1024];
+    };
+}
+
+#endif
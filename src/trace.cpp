@@ -0,0 +1,159 @@
+#include "trace.h"
+
+#include "wire.h"
+
+using namespace stone;
+
+namespace
+{
+    const char TRACE_MAGIC[4] = {'K', 'T', 'R', 'C'};
+    const uint32_t TRACE_VERSION = 1;
+    const size_t TRACE_HEAD = 4 + 4 + 4 + 8 + 8; // magic, version, conv, lost, count
+    const size_t TRACE_EVENT = 4 + 4 + 4 + 1;    // ts, sn, value, type
+
+    void store64(char *p, uint64_t v)
+    {
+        wire_store32(p, static_cast<uint32_t>(v));
+        wire_store32(p + 4, static_cast<uint32_t>(v >> 32));
+    }
+
+    uint64_t load64(const char *p)
+    {
+        return wire_load32(p) | (static_cast<uint64_t>(wire_load32(p + 4)) << 32);
+    }
+}
+
+KcpTrace::KcpTrace(uint32_t capacity) : next_(0)
+{
+    uint32_t size = 1;
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+    events_.reset(new KcpTraceEvent[size]());
+    mask_ = size - 1;
+}
+
+size_t KcpTrace::copy(KcpTraceEvent *events, size_t max) const
+{
+    size_t count = size() < max ? size() : max;
+    uint64_t first = next_ - count;
+    for (size_t i = 0; i < count; i++)
+    {
+        events[i] = events_[(first + i) & mask_];
+    }
+    return count;
+}
+
+bool KcpTrace::save(FILE *file, uint32_t conv) const
+{
+    char head[TRACE_HEAD];
+    memcpy(head, TRACE_MAGIC, 4);
+    wire_store32(head + 4, TRACE_VERSION);
+    wire_store32(head + 8, conv);
+    store64(head + 12, lost());
+    store64(head + 20, size());
+    if (fwrite(head, 1, sizeof(head), file) != sizeof(head))
+    {
+        return false;
+    }
+
+    uint64_t first = next_ - size();
+    for (uint64_t i = first; i < next_; i++)
+    {
+        const KcpTraceEvent &event = events_[i & mask_];
+        char record[TRACE_EVENT];
+        wire_store32(record, event.ts);
+        wire_store32(record + 4, event.sn);
+        wire_store32(record + 8, event.value);
+        record[12] = static_cast<char>(event.type);
+        if (fwrite(record, 1, sizeof(record), file) != sizeof(record))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool stone::kcp_trace_load(FILE *file, uint32_t &conv, uint64_t &lost, std::unique_ptr<KcpTraceEvent[]> &events,
+                           size_t &count)
+{
+    char head[TRACE_HEAD];
+    if (fread(head, 1, sizeof(head), file) != sizeof(head) || memcmp(head, TRACE_MAGIC, 4) != 0 ||
+        wire_load32(head + 4) != TRACE_VERSION)
+    {
+        return false;
+    }
+    conv = wire_load32(head + 8);
+    lost = load64(head + 12);
+    uint64_t size = load64(head + 20);
+    if (size > (1u << 30)) // larger than any ring
+    {
+        return false;
+    }
+
+    count = static_cast<size_t>(size);
+    events.reset(new KcpTraceEvent[count]);
+    for (size_t i = 0; i < count; i++)
+    {
+        char record[TRACE_EVENT];
+        if (fread(record, 1, sizeof(record), file) != sizeof(record))
+        {
+            return false;
+        }
+        events[i].ts = wire_load32(record);
+        events[i].sn = wire_load32(record + 4);
+        events[i].value = wire_load32(record + 8);
+        events[i].type = static_cast<uint8_t>(record[12]);
+    }
+    return true;
+}
+
+const char *stone::kcp_trace_name(uint8_t type)
+{
+    switch (type)
+    {
+    case KCP_TRACE_SEND:
+        return "send";
+    case KCP_TRACE_RESEND:
+        return "resend";
+    case KCP_TRACE_FASTRESEND:
+        return "fastresend";
+    case KCP_TRACE_ACK:
+        return "ack";
+    case KCP_TRACE_OUTOFORDER:
+        return "outoforder";
+    case KCP_TRACE_PROBE:
+        return "probe";
+    case KCP_TRACE_CWND:
+        return "cwnd";
+    default:
+        return "unknown";
+    }
+}
+
+void stone::kcp_trace_print(FILE *out, const KcpTraceEvent *events, size_t count, bool json)
+{
+    if (json)
+    {
+        fprintf(out, "[");
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        const KcpTraceEvent &event = events[i];
+        const char *name = kcp_trace_name(event.type);
+        if (json)
+        {
+            fprintf(out, "%s\n{\"ts\":%u,\"event\":\"%s\",\"sn\":%u,\"value\":%u}", i > 0 ? "," : "", event.ts, name,
+                    event.sn, event.value);
+        }
+        else
+        {
+            fprintf(out, "%10u %-10s sn=%u value=%u\n", event.ts, name, event.sn, event.value);
+        }
+    }
+    if (json)
+    {
+        fprintf(out, "\n]\n");
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef STONE_TRACE_H
+#define STONE_TRACE_H
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+namespace stone
+{
+    // Per-session protocol trace: a fixed size ring of binary events, the
+    // oldest overwritten first. Enabled by Kcpp::set_trace(), disabled it
+    // costs one test of a null pointer per event site.
+
+    enum KcpTraceType : uint8_t
+    {
+        KCP_TRACE_SEND = 1,   // sn first sent, value: len
+        KCP_TRACE_RESEND,     // sn resent after rto, value: xmit
+        KCP_TRACE_FASTRESEND, // sn resent after skipped acks, value: xmit
+        KCP_TRACE_ACK,        // sn acked, value: rtt
+        KCP_TRACE_OUTOFORDER, // sn received ahead of rcv_nxt, value: rcv_nxt
+        KCP_TRACE_PROBE,      // window probe sent, value: KCP_ASK_* flags
+        KCP_TRACE_CWND,       // cwnd changed, sn: ssthresh, value: cwnd
+    };
+
+    struct KcpTraceEvent
+    {
+        uint32_t ts;  // low 32 bits of the session clock
+        uint32_t sn;
+        uint32_t value;
+        uint8_t type; // KcpTraceType
+    };
+
+    class KcpTrace
+    {
+    public:
+        // capacity is rounded up to a power of two
+        explicit KcpTrace(uint32_t capacity);
+
+        void record(uint8_t type, uint32_t ts, uint32_t sn, uint32_t value)
+        {
+            KcpTraceEvent &event = events_[next_++ & mask_];
+            event.ts = ts;
+            event.sn = sn;
+            event.value = value;
+            event.type = type;
+        }
+
+        // events still in the ring, and how many were overwritten
+        size_t size() const { return next_ > mask_ ? mask_ + 1 : static_cast<size_t>(next_); }
+        uint64_t lost() const { return next_ - size(); }
+
+        // copy out the events oldest first, returns the count
+        size_t copy(KcpTraceEvent *events, size_t max) const;
+
+        // binary dump for kcp_trace, little endian whatever the host
+        bool save(FILE *file, uint32_t conv) const;
+
+        uint32_t cwnd = 0; // last traced cwnd, see KCP_TRACE_CWND
+
+    private:
+        std::unique_ptr<KcpTraceEvent[]> events_;
+        uint32_t mask_;
+        uint64_t next_;
+    };
+
+    // read a dump written by KcpTrace::save(), returns false if it is not one
+    bool kcp_trace_load(FILE *file, uint32_t &conv, uint64_t &lost, std::unique_ptr<KcpTraceEvent[]> &events,
+                        size_t &count);
+
+    // one line per event, or a JSON array of objects
+    void kcp_trace_print(FILE *out, const KcpTraceEvent *events, size_t count, bool json);
+
+    const char *kcp_trace_name(uint8_t type);
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef STONE_WIRE_H
+#define STONE_WIRE_H
+#include "kcpp.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace stone
+{
+    // KCP wire format: every multi-byte field is little endian, whatever the
+    // host. Loads and stores go through memcpy so they are safe on targets
+    // that trap on unaligned access; on little endian hosts the header is
+    // a single 24-byte copy.
+
+    static_assert(sizeof(kcpHeader) == KCP_OVERHEAD, "kcpHeader must match the wire header");
+    static_assert(offsetof(kcpHeader, cmd) == 4 && offsetof(kcpHeader, wnd) == 6 &&
+                      offsetof(kcpHeader, ts) == 8 && offsetof(kcpHeader, len) == 20,
+                  "kcpHeader must match the wire header");
+
+    constexpr uint16_t wire_bswap16(uint16_t v)
+    {
+        return static_cast<uint16_t>((v >> 8) | (v << 8));
+    }
+
+    constexpr uint32_t wire_bswap32(uint32_t v)
+    {
+        return (v >> 24) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+    }
+
+    // host order <-> little endian, a no-op on little endian hosts
+    constexpr uint16_t wire_le16(uint16_t v)
+    {
+        return IWORDS_BIG_ENDIAN ? wire_bswap16(v) : v;
+    }
+
+    constexpr uint32_t wire_le32(uint32_t v)
+    {
+        return IWORDS_BIG_ENDIAN ? wire_bswap32(v) : v;
+    }
+
+    inline uint16_t wire_load16(const char *p)
+    {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return wire_le16(v);
+    }
+
+    inline uint32_t wire_load32(const char *p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return wire_le32(v);
+    }
+
+    inline char *wire_store16(char *p, uint16_t v)
+    {
+        v = wire_le16(v);
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+
+    inline char *wire_store32(char *p, uint32_t v)
+    {
+        v = wire_le32(v);
+        memcpy(p, &v, sizeof(v));
+        return p + sizeof(v);
+    }
+
+    // write the 24-byte header, returns the position after it
+    inline char *wire_encode_header(char *p, const kcpHeader &header)
+    {
+#if IWORDS_BIG_ENDIAN
+        p = wire_store32(p, header.conv);
+        *p++ = static_cast<char>(header.cmd);
+        *p++ = static_cast<char>(header.frg);
+        p = wire_store16(p, header.wnd);
+        p = wire_store32(p, header.ts);
+        p = wire_store32(p, header.sn);
+        p = wire_store32(p, header.una);
+        p = wire_store32(p, header.len);
+        return p;
+#else
+        memcpy(p, &header, KCP_OVERHEAD);
+        return p + KCP_OVERHEAD;
+#endif
+    }
+
+    // read the 24-byte header, returns the position after it
+    inline const char *wire_decode_header(const char *p, kcpHeader &header)
+    {
+#if IWORDS_BIG_ENDIAN
+        header.conv = wire_load32(p);
+        header.cmd = static_cast<uint8_t>(p[4]);
+        header.frg = static_cast<uint8_t>(p[5]);
+        header.wnd = wire_load16(p + 6);
+        header.ts = wire_load32(p + 8);
+        header.sn = wire_load32(p + 12);
+        header.una = wire_load32(p + 16);
+        header.len = wire_load32(p + 20);
+#else
+        memcpy(&header, p, KCP_OVERHEAD);
+#endif
+        return p + KCP_OVERHEAD;
+    }
+
+    // decode up to max consecutive full headers of a datagram, skipping
+    // their data. Stops at a truncated segment or after a header flagged
+    // KCP_CMD_COMPACT, since compact headers follow it. Returns the number
+    // of headers, offsets[i] is where the data of headers[i] starts.
+    inline int wire_decode_headers(const char *data, uint32_t size, kcpHeader *headers,
+                                   uint32_t *offsets, int max)
+    {
+        uint32_t pos = 0;
+        int count = 0;
+        while (count < max && size - pos >= KCP_OVERHEAD)
+        {
+            // len and cmd straight from the wire, so finding the next
+            // header does not wait on the copy of this one
+            const char *p = data + pos;
+            uint32_t len = wire_load32(p + 20);
+            uint8_t cmd = static_cast<uint8_t>(p[4]);
+            if (len > size - pos - KCP_OVERHEAD)
+                break;
+            wire_decode_header(p, headers[count]);
+            offsets[count++] = pos + KCP_OVERHEAD;
+            pos += KCP_OVERHEAD + len;
+            if (cmd & KCP_CMD_COMPACT)
+                break;
+        }
+        return count;
+    }
+}
+
+#endif
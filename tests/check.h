@@ -0,0 +1,40 @@
+//=====================================================================
+//
+// check.h - pass/fail helpers of the tests
+//
+// Each test is its own binary (xmake test, or xmake run test_<name>).
+// A failed CHECK prints where it failed and the run goes on; main
+// returns report(), non-zero once anything failed.
+//
+//=====================================================================
+
+#ifndef STONE_TESTS_CHECK_H
+#define STONE_TESTS_CHECK_H
+#include <cstdio>
+
+namespace stone_test
+{
+    inline int &failures()
+    {
+        static int count = 0;
+        return count;
+    }
+
+    inline int report(const char *name)
+    {
+        printf("%s: %s\n", name, failures() == 0 ? "ok" : "FAILED");
+        return failures() == 0 ? 0 : 1;
+    }
+}
+
+#define CHECK(cond)                                                                \
+    do                                                                             \
+    {                                                                              \
+        if (!(cond))                                                               \
+        {                                                                          \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);        \
+            stone_test::failures()++;                                              \
+        }                                                                          \
+    } while (0)
+
+#endif
@@ -0,0 +1,138 @@
+//=====================================================================
+//
+// test_autotune.cpp - receive window auto-tuning
+//
+// A bulk transfer over a simulated 100 Mbit/s, 200 ms rtt link with
+// the default 128 segment window. Tuned, the window grows up to the
+// per-session cap and the throughput with it. A reader that stops
+// shrinks it again, a process-wide memory limit holds growth back, and
+// the memory reserved in KcpRcvMemory goes back to 0 on set_wndsize()
+// and on destruction.
+//
+//=====================================================================
+
+#include <memory>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    const uint64_t mss = KCP_MTU_DEF - KCP_OVERHEAD;
+
+    // kcp1 keeps kcp2 busy, kcp2 reads while reading is set
+    struct Transfer
+    {
+        Kcpp kcp1{1, nullptr}, kcp2{1, nullptr};
+        NetSim sim{1};
+        bool reading = true;
+        uint64_t received = 0;
+
+        explicit Transfer(uint64_t autotune)
+        {
+            kcp1.no_delay(1, 10, 2, true);
+            kcp2.no_delay(1, 10, 2, true);
+            kcp1.set_wndsize(4096, KCP_WND_RCV);
+            if (autotune > 0)
+                kcp2.set_rcv_autotune(autotune);
+
+            NetSimLink link;
+            link.delay_min = link.delay_max = 100;
+            link.bandwidth = 12500000;
+            sim.attach(kcp1, kcp2, link, link);
+
+            std::vector<char> message(mss), buffer(mss);
+            sim.set_poll([this, message, buffer]() mutable {
+                while (kcp1.wait_send_size() < 8192)
+                    kcp1.send(message.data(), static_cast<int>(message.size()));
+                int hr;
+                while (reading && (hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+                    received += static_cast<uint64_t>(hr);
+            });
+        }
+    };
+
+    void growth()
+    {
+        uint64_t fixed;
+        {
+            Transfer transfer(0);
+            transfer.sim.run(10000);
+            fixed = transfer.received;
+            CHECK(transfer.kcp2.stats().rcv_wnd == KCP_WND_RCV);
+        }
+        CHECK(KcpRcvMemory::used == 0);
+
+        const uint32_t cap = 2000;
+        Transfer transfer(cap * mss);
+        transfer.sim.run(10000);
+        uint32_t wnd = transfer.kcp2.stats().rcv_wnd;
+        CHECK(wnd > KCP_WND_RCV * 4);
+        CHECK(wnd <= cap);
+        CHECK(KcpRcvMemory::used == (wnd - KCP_WND_RCV) * mss);
+        // one window per rtt, 1.3 times the fixed window to start with
+        CHECK(transfer.received > fixed * 5);
+
+        // the tuned part is given back
+        transfer.kcp2.set_wndsize(0, KCP_WND_RCV);
+        CHECK(KcpRcvMemory::used == 0);
+        CHECK(transfer.kcp2.stats().rcv_wnd < wnd);
+    }
+
+    void shrink()
+    {
+        uint32_t wnd;
+        {
+            Transfer transfer(4096 * mss);
+            transfer.sim.run(10000);
+            wnd = transfer.kcp2.stats().rcv_wnd;
+            CHECK(wnd > KCP_WND_RCV * 4);
+
+            // the data piles up
+            transfer.reading = false;
+            transfer.sim.run(20000);
+            uint32_t shrunk = transfer.kcp2.stats().rcv_wnd;
+            CHECK(shrunk < wnd / 4 && shrunk >= KCP_WND_RCV);
+            CHECK(KcpRcvMemory::used == (shrunk - KCP_WND_RCV) * mss);
+        }
+        CHECK(KcpRcvMemory::used == 0);
+    }
+
+    // two sessions share a limit of 500 segments
+    void limit()
+    {
+        const uint64_t ceiling = 500 * mss;
+        Kcpp::set_rcv_memory_limit(ceiling);
+        {
+            auto first = std::make_unique<Transfer>(4096 * mss);
+            Transfer second(4096 * mss);
+            first->sim.run(10000);
+            second.sim.run(10000);
+            uint32_t wnd1 = first->kcp2.stats().rcv_wnd, wnd2 = second.kcp2.stats().rcv_wnd;
+            CHECK(wnd1 > KCP_WND_RCV && wnd2 >= KCP_WND_RCV);
+            CHECK(KcpRcvMemory::used == (wnd1 + wnd2 - 2 * KCP_WND_RCV) * mss);
+            CHECK(KcpRcvMemory::used <= ceiling);
+
+            // the memory of the first is free for the second to grow into
+            first.reset();
+            CHECK(KcpRcvMemory::used == (wnd2 - KCP_WND_RCV) * mss);
+            second.sim.run(20000);
+            CHECK(second.kcp2.stats().rcv_wnd > wnd2);
+            CHECK(KcpRcvMemory::used <= ceiling);
+        }
+        CHECK(KcpRcvMemory::used == 0);
+        Kcpp::set_rcv_memory_limit(0);
+    }
+}
+
+int main()
+{
+    growth();
+    shrink();
+    limit();
+    return stone_test::report("test_autotune");
+}
@@ -0,0 +1,120 @@
+//=====================================================================
+//
+// test_clock.cpp - the session clock across the 32 bit wrap
+//
+// Two sessions driven through update() with a uint32 clock that starts
+// just below 2^32 and wraps mid transfer, in us mode (the wrap every 71
+// minutes) and in ms mode. Datagrams are delayed and some dropped, and
+// the acks stall just before the wrap, so resends and the spurious
+// retransmission check compare wire timestamps from both sides of it.
+// Everything must arrive, and every tick the sender must be in the same
+// state as in the same run from clock 0.
+//
+//=====================================================================
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    struct Datagram
+    {
+        uint64_t at; // ticks since the start
+        std::string data;
+    };
+
+    // the sender's rtt estimate and window after every tick
+    std::vector<int64_t> transfer(bool us, uint32_t start)
+    {
+        const uint64_t unit = us ? 1000 : 1;    // ticks per ms
+        const uint64_t delay = 20 * unit;       // one way
+        const uint64_t span = 6000 * unit;      // the wrap is 2s in
+
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        CHECK(kcp1.set_clock_us(us));
+        CHECK(kcp2.set_clock_us(us));
+        kcp1.no_delay(1, static_cast<int>(10 * unit), 2, true);
+        kcp2.no_delay(1, static_cast<int>(10 * unit), 2, true);
+        kcp1.set_undo(true);
+
+        uint64_t elapsed = 0;
+        uint32_t seed = 1;
+        std::deque<Datagram> to1, to2;
+        kcp1.set_output([&](const char *buf, int len, Kcpp *, void *) {
+            seed = seed * 1103515245 + 12345; // a fixed 1 in 10 loss
+            if ((seed >> 16) % 10 != 0)
+                to2.push_back({elapsed + delay, std::string(buf, len)});
+            return len;
+        });
+        kcp2.set_output([&](const char *buf, int len, Kcpp *, void *) {
+            // acks sent in the 100ms before the wrap come late, the data is
+            // resent after it and then acked as the original transmission
+            bool stall = elapsed >= 1900 * unit && elapsed < 2000 * unit;
+            to1.push_back({elapsed + (stall ? 10 * delay : delay), std::string(buf, len)});
+            return len;
+        });
+        auto deliver = [&elapsed](std::deque<Datagram> &queue, Kcpp &kcp) {
+            while (!queue.empty() && queue.front().at <= elapsed)
+            {
+                kcp.input(queue.front().data.data(), static_cast<uint32_t>(queue.front().data.size()));
+                queue.pop_front();
+            }
+        };
+
+        const int count = 1500;
+        int sent = 0, received = 0;
+        bool intact = true;
+        std::vector<char> buffer(4096);
+        std::vector<int64_t> trace;
+        for (; elapsed < span; elapsed += unit)
+        {
+            // a steady stream, so segments are in flight across the wrap
+            if (sent < count && elapsed % (2 * unit) == 0)
+            {
+                std::string text(100 + sent % 1000, static_cast<char>(sent));
+                kcp1.send(text.data(), static_cast<int>(text.size()));
+                sent++;
+            }
+            uint32_t current = start + static_cast<uint32_t>(elapsed);
+            kcp1.update(current);
+            kcp2.update(current);
+            deliver(to2, kcp2);
+            deliver(to1, kcp1);
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                intact = intact && hr == 100 + received % 1000 && buffer[hr - 1] == static_cast<char>(received);
+                received++;
+            }
+            KcpStats stats = kcp1.stats();
+            trace.insert(trace.end(), {stats.srtt, stats.rttvar, stats.rto, stats.cwnd, stats.ssthresh,
+                                       static_cast<int64_t>(stats.segs_retrans)});
+        }
+        CHECK(sent == count);
+        CHECK(received == count);
+        CHECK(intact);
+
+        // the rtt is 40ms, the estimate must not be thrown off by the wrap
+        KcpStats stats = kcp1.stats();
+        CHECK(stats.srtt >= static_cast<int32_t>(40 * unit) && stats.srtt < static_cast<int32_t>(200 * unit));
+        CHECK(stats.rto > 0 && stats.rto < static_cast<int32_t>(1000 * unit));
+        CHECK(stats.segs_retrans > 0);
+        CHECK(kcp1.wait_send_size() == 0);
+        return trace;
+    }
+}
+
+int main()
+{
+    const uint64_t wrap = uint64_t(1) << 32;
+    CHECK(transfer(true, static_cast<uint32_t>(wrap - 2000 * 1000)) == transfer(true, 0));
+    CHECK(transfer(false, static_cast<uint32_t>(wrap - 2000)) == transfer(false, 0));
+    return stone_test::report("test_clock");
+}
@@ -0,0 +1,134 @@
+//=====================================================================
+//
+// test_compress.cpp - KCP_CMD_PUSHZ messages
+//
+// Compressible messages of one to many fragments go through a lossy
+// simulated network intact and in order, and compressed. A compressed
+// message whose size does not match its data is dropped by recv() and
+// counted, and the messages behind it are still delivered.
+//
+//=====================================================================
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+#include "wire.h"
+
+using namespace stone;
+
+namespace
+{
+    std::string message(int i)
+    {
+        std::string text;
+        int size = 64 + (i * 7919) % 20000;
+        while (static_cast<int>(text.size()) < size)
+            text += "message " + std::to_string(i) + " of the compression test, ";
+        text.resize(size);
+        return text;
+    }
+
+    void round_trip(uint64_t seed, double loss)
+    {
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        for (Kcpp *kcp : {&kcp1, &kcp2})
+        {
+            kcp->set_compress(true);
+            kcp->set_wndsize(256, 256);
+        }
+        NetSimLink link;
+        link.delay_min = 10;
+        link.delay_max = 20;
+        link.loss_good = loss;
+        NetSim sim(seed);
+        sim.attach(kcp1, kcp2, link, link);
+        sim.run(2000); // negotiated
+
+        const int count = 200;
+        uint64_t raw = 0;
+        for (int i = 0; i < count; i++)
+        {
+            std::string text = message(i);
+            raw += text.size();
+            CHECK(kcp1.send(text.data(), static_cast<int>(text.size())) == 0);
+        }
+        int received = 0;
+        bool intact = true;
+        std::vector<char> buffer(32 * 1024);
+        sim.set_poll([&] {
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                intact = intact && std::string(buffer.data(), hr) == message(received);
+                received++;
+            }
+        });
+        sim.run(120000);
+        CHECK(received == count);
+        CHECK(intact);
+        CHECK(kcp2.stats().corrupt_dropped == 0);
+        if (loss == 0)
+            CHECK(kcp1.stats().bytes_sent < raw / 2);
+    }
+
+    // a segment as the remote would send it
+    std::string segment(uint8_t cmd, uint32_t sn, const std::string &data)
+    {
+        kcpHeader header;
+        memset(&header, 0, sizeof(header));
+        header.conv = 1;
+        header.cmd = cmd;
+        header.wnd = 128;
+        header.sn = sn;
+        header.len = static_cast<uint32_t>(data.size());
+        std::string out(KCP_OVERHEAD, '\0');
+        wire_encode_header(&out[0], header);
+        return out + data;
+    }
+
+    std::string pushz(uint32_t raw, const std::string &packed)
+    {
+        std::string data(KCP_ZHEAD, '\0');
+        wire_store32(&data[0], raw);
+        return data + packed;
+    }
+
+    void corrupt()
+    {
+        Kcpp kcp(1, nullptr);
+        kcp.set_output([](const char *, int len, Kcpp *, void *) { return len; });
+        kcp.update(0);
+
+        // a size no 8 bytes decompress to, one that does not match them,
+        // then an intact message
+        std::string datagram = segment(KCP_CMD_PUSHZ, 0, pushz(1u << 30, "abcdefgh")) +
+                               segment(KCP_CMD_PUSHZ, 1, pushz(100, "abcdefgh")) +
+                               segment(KCP_CMD_PUSH, 2, "hello");
+        CHECK(kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size())) == 0);
+
+        char buffer[256];
+        CHECK(kcp.peek_size() == 0);
+        CHECK(kcp.recv(buffer, sizeof(buffer)) == -4);
+        CHECK(kcp.peek_size() == 100);
+        CHECK(kcp.recv(buffer, sizeof(buffer)) == -4);
+        CHECK(kcp.recv(buffer, sizeof(buffer)) == 5);
+        CHECK(memcmp(buffer, "hello", 5) == 0);
+        CHECK(kcp.recv(buffer, sizeof(buffer)) == -1);
+        CHECK(kcp.stats().corrupt_dropped == 2);
+    }
+}
+
+int main()
+{
+    round_trip(1, 0);
+    for (uint64_t seed = 1; seed <= 5; seed++)
+    {
+        round_trip(seed, 0.1);
+    }
+    corrupt();
+    return stone_test::report("test_compress");
+}
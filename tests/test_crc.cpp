@@ -0,0 +1,187 @@
+//=====================================================================
+//
+// test_crc.cpp - crc32c and set_checksum() datagrams
+//
+// Both crc32c implementations against the reference value and each
+// other, a checksummed transfer through a network that flips bits in
+// some datagrams, alone and under set_cipher(), and rejection of any
+// single altered byte of a datagram.
+//
+//=====================================================================
+
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    void vectors()
+    {
+        std::vector<char> data(4096);
+        std::mt19937 random(7);
+        for (char &c : data)
+            c = static_cast<char>(random());
+
+        uint32_t crc[2][64];
+        for (int hw = 0; hw < 2; hw++)
+        {
+            crc32c_set_hw(hw != 0);
+            CHECK(crc32c(0, "123456789", 9) == 0xe3069283);
+            CHECK(crc32c(0, data.data(), 0) == 0);
+            // continued in pieces at every alignment
+            uint32_t whole = crc32c(0, data.data(), static_cast<int>(data.size()));
+            for (int split = 0; split < 17; split++)
+                CHECK(crc32c(crc32c(0, data.data(), split), data.data() + split,
+                             static_cast<int>(data.size()) - split) == whole);
+            for (int i = 0; i < 64; i++)
+                crc[hw][i] = crc32c(0, data.data() + i, 1 + i * 61);
+        }
+        crc32c_set_hw(true);
+        CHECK(memcmp(crc[0], crc[1], sizeof(crc[0])) == 0);
+    }
+
+    // a session whose incoming datagrams sometimes have a bit flipped
+    class Flaky
+    {
+    public:
+        using Output = std::function<int(const char *buf, int len, Flaky *kcp, void *user)>;
+
+        Flaky(Kcpp &kcp, uint64_t seed, double chance) : kcp_(kcp), random_(seed), chance_(chance)
+        {
+            kcp_.set_output([this](const char *buf, int len, Kcpp *, void *) { return output_(buf, len, this, nullptr); });
+        }
+
+        void set_output(const Output &output)
+        {
+            output_ = output;
+        }
+        int input(const char *data, uint32_t size)
+        {
+            std::string datagram(data, size);
+            bool flip = std::uniform_real_distribution<double>(0, 1)(random_) < chance_;
+            if (flip)
+            {
+                datagram[random_() % size] ^= static_cast<char>(1 << (random_() % 8));
+                flipped++;
+            }
+            int hr = kcp_.input(datagram.data(), size);
+            if (hr == -4)
+                rejected++;
+            return hr;
+        }
+        void update(uint32_t current)
+        {
+            kcp_.update(current);
+        }
+        int32_t check(uint32_t current)
+        {
+            return kcp_.check(current);
+        }
+
+        int flipped = 0, rejected = 0;
+
+    private:
+        Kcpp &kcp_;
+        std::mt19937_64 random_;
+        double chance_;
+        Output output_;
+    };
+
+    uint8_t key1[AEAD_KEY_LEN] = {1}, key2[AEAD_KEY_LEN] = {2};
+
+    void round_trip(uint64_t seed, bool sealed)
+    {
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        CHECK(kcp1.set_checksum(true));
+        CHECK(kcp2.set_checksum(true));
+        if (sealed)
+        {
+            CHECK(kcp1.set_cipher(key1, key2));
+            CHECK(kcp2.set_cipher(key2, key1));
+        }
+        Flaky flaky1(kcp1, seed, 0.1), flaky2(kcp2, seed + 100, 0.1);
+        NetSimLink link;
+        link.loss_good = 0.05;
+        NetSim sim(seed);
+        sim.attach(flaky1, flaky2, link, link);
+
+        const int count = 300;
+        for (int i = 0; i < count; i++)
+        {
+            std::string text(1 + (i * 37) % 3000, static_cast<char>(i));
+            kcp1.send(text.data(), static_cast<int>(text.size()));
+        }
+        int received = 0;
+        bool intact = true;
+        std::vector<char> buffer(4096);
+        sim.set_poll([&] {
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                intact = intact && hr == 1 + (received * 37) % 3000 && buffer[hr - 1] == static_cast<char>(received);
+                received++;
+            }
+        });
+        sim.run(120000);
+        CHECK(received == count);
+        CHECK(intact);
+        // every flipped datagram and nothing else was rejected
+        CHECK(flaky2.flipped > 0);
+        CHECK(flaky1.rejected == flaky1.flipped);
+        CHECK(flaky2.rejected == flaky2.flipped);
+        CHECK(kcp2.stats().datagrams_received == sim.stats(0).delivered - static_cast<uint64_t>(flaky2.flipped));
+    }
+
+    void corruption()
+    {
+        std::string datagram;
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        kcp1.set_checksum(true);
+        kcp2.set_checksum(true);
+        kcp1.no_delay(1, 10, 2, true);
+        kcp1.set_output([&datagram](const char *buf, int len, Kcpp *, void *) {
+            datagram.assign(buf, len);
+            return len;
+        });
+        kcp2.set_output([](const char *, int len, Kcpp *, void *) { return len; });
+        kcp1.send("a checksummed message", 21);
+        kcp1.update(0);
+        kcp1.flush();
+        CHECK(datagram.size() == KCP_OVERHEAD + 21 + KCP_CRC_LEN);
+
+        for (size_t i = 0; i < datagram.size(); i++)
+        {
+            std::string altered = datagram;
+            altered[i] ^= 0x20;
+            CHECK(kcp2.input(altered.data(), static_cast<uint32_t>(altered.size())) == -4);
+        }
+        CHECK(kcp2.input(datagram.data(), KCP_OVERHEAD + KCP_CRC_LEN - 1) == -1);
+        CHECK(kcp2.stats().datagrams_received == 0);
+        CHECK(kcp2.peek_size() == -1);
+
+        char buffer[64];
+        CHECK(kcp2.input(datagram.data(), static_cast<uint32_t>(datagram.size())) == 0);
+        CHECK(kcp2.recv(buffer, sizeof(buffer)) == 21);
+        CHECK(memcmp(buffer, "a checksummed message", 21) == 0);
+    }
+}
+
+int main()
+{
+    vectors();
+    for (uint64_t seed = 1; seed <= 5; seed++)
+    {
+        round_trip(seed, false);
+        round_trip(seed, true);
+    }
+    corruption();
+    return stone_test::report("test_crc");
+}
@@ -0,0 +1,141 @@
+//=====================================================================
+//
+// test_file.cpp - send_file()
+//
+// A file region and a pipe arrive intact. Ranges past the end of the
+// file and pipes that cannot be read as the window admits are refused
+// up front. A file that shrinks before any of it is mapped and a pipe
+// that ends early cut the transfer short without faulting, and the
+// missing bytes are counted.
+//
+//=====================================================================
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    std::string content(size_t size)
+    {
+        std::string text;
+        for (size_t i = 0; text.size() < size; i++)
+            text += std::to_string(i) + ",";
+        text.resize(size);
+        return text;
+    }
+
+    // a temporary file holding text, removed once opened
+    int temp_file(const std::string &text)
+    {
+        char path[] = "/tmp/test_file.XXXXXX";
+        int fd = mkstemp(path);
+        unlink(path);
+        CHECK(write(fd, text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        return fd;
+    }
+
+    // what kcp2 receives within 60s, after before() ran on kcp1
+    template <typename F>
+    std::string transfer(F before, KcpStats *stats = nullptr)
+    {
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        for (Kcpp *kcp : {&kcp1, &kcp2})
+            kcp->no_delay(1, 10, 2, true);
+        NetSimLink link;
+        link.loss_good = 0.05;
+        NetSim sim(1);
+        sim.attach(kcp1, kcp2, link, link);
+        before(kcp1);
+
+        std::string received;
+        std::vector<char> buffer(256 * 1024);
+        sim.set_poll([&] {
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+                received.append(buffer.data(), hr);
+        });
+        sim.run(60000);
+        if (stats)
+            *stats = kcp1.stats();
+        return received;
+    }
+
+    void file()
+    {
+        std::string text = content(1 << 20);
+        int fd = temp_file(text);
+        std::string received = transfer([&](Kcpp &kcp) {
+            CHECK(kcp.send_file(fd, 0, 4000) == 0);
+            CHECK(kcp.send_file(fd, 12345, text.size() - 12345) == 0);
+            CHECK(kcp.send_file(fd, text.size(), 0) == 0);
+        });
+        CHECK(received == text.substr(0, 4000) + text.substr(12345));
+
+        Kcpp kcp(1, nullptr);
+        CHECK(kcp.send_file(fd, 0, text.size() + 1) == -1);
+        CHECK(kcp.send_file(fd, text.size() + 1, 0) == -1);
+        CHECK(kcp.send_file(fd, 1, UINT64_MAX) == -1);
+        CHECK(kcp.send_file(-1, 0, 1) == -1);
+        close(fd);
+    }
+
+    void shrinking_file()
+    {
+        std::string text = content(1 << 20);
+        int fd = temp_file(text);
+        KcpStats stats;
+        std::string received = transfer(
+            [&](Kcpp &kcp) {
+                CHECK(kcp.send_file(fd, 0, text.size()) == 0);
+                CHECK(ftruncate(fd, 100000) == 0);
+            },
+            &stats);
+        CHECK(received == text.substr(0, 100000));
+        CHECK(stats.file_short == text.size() - 100000);
+        close(fd);
+    }
+
+    void pipe_ends(size_t written, size_t asked)
+    {
+        std::string text = content(written);
+        int fds[2];
+        CHECK(pipe(fds) == 0);
+        CHECK(write(fds[1], text.data(), text.size()) == static_cast<ssize_t>(text.size()));
+        close(fds[1]);
+
+        KcpStats stats;
+        std::string received = transfer(
+            [&](Kcpp &kcp) {
+                CHECK(kcp.send_file(fds[0], 1, asked) == -1);
+                CHECK(kcp.send_file(fds[0], 0, asked) == 0);
+            },
+            &stats);
+        CHECK(received == text.substr(0, asked));
+        CHECK(stats.file_short == (asked > written ? asked - written : 0));
+
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        Kcpp kcp(1, nullptr);
+        CHECK(kcp.send_file(fds[0], 0, 1) == -1);
+        close(fds[0]);
+    }
+}
+
+int main()
+{
+    file();
+    shrinking_file();
+    pipe_ends(30000, 30000);
+    pipe_ends(30000, 20000);
+    pipe_ends(30000, 50000);
+    return stone_test::report("test_file");
+}
@@ -0,0 +1,149 @@
+//=====================================================================
+//
+// test_lifetime.cpp - messages sent with a lifetime
+//
+// The middle fragment of a three fragment message is lost until the
+// message has expired: the receiver must drop the fragments it holds
+// and deliver the next message, and the byte counts of both sides go
+// back to 0. The same with the whole message lost, and with a message
+// which expires before it is sent at all.
+//
+//=====================================================================
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    using Datagrams = std::vector<std::string>;
+
+    const int mss = static_cast<int>(KCP_MTU_DEF - KCP_OVERHEAD);
+
+    struct Pair
+    {
+        Kcpp a{1, nullptr}, b{1, nullptr};
+        Datagrams ab, ba;
+        uint32_t current = 0;
+
+        Pair()
+        {
+            a.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ab.emplace_back(buf, len);
+                return len;
+            });
+            b.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ba.emplace_back(buf, len);
+                return len;
+            });
+            a.no_delay(1, 10, 2, true);
+            b.no_delay(1, 10, 2, true);
+        }
+
+        static void deliver(Datagrams &datagrams, Kcpp &kcp)
+        {
+            for (auto &datagram : datagrams)
+                kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size()));
+            datagrams.clear();
+        }
+
+        // ticks for ms, a's datagrams for which lost() is true are dropped,
+        // returns the messages b received
+        template <typename F>
+        std::vector<std::string> run(uint32_t ms, F lost)
+        {
+            std::vector<std::string> received;
+            std::vector<char> buffer(8 * mss);
+            for (uint32_t end = current + ms; current < end;)
+            {
+                current += 10;
+                a.update(current);
+                b.update(current);
+                for (auto &datagram : ab)
+                    if (!lost(datagram))
+                        b.input(datagram.data(), static_cast<uint32_t>(datagram.size()));
+                ab.clear();
+                deliver(ba, a);
+                int hr;
+                while ((hr = b.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+                    received.emplace_back(buffer.data(), hr);
+            }
+            return received;
+        }
+
+        void check_idle()
+        {
+            CHECK(a.wait_send_size() == 0);
+            CHECK(a.queued_bytes() == 0);
+            CHECK(a.inflight_bytes() == 0);
+            CHECK(b.buffered_bytes() == 0);
+        }
+    };
+
+    // a datagram carrying a fragment of fill, each goes in a datagram of its own
+    bool has(const std::string &datagram, char fill)
+    {
+        return datagram.size() > KCP_OVERHEAD && datagram.back() == fill;
+    }
+
+    void middle_fragment_lost()
+    {
+        Pair pair;
+        std::string message = std::string(mss, '1') + std::string(mss, '2') + std::string(mss, '3');
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size()), 0, 100) == 0);
+        auto received = pair.run(300, [](const std::string &datagram) { return has(datagram, '2'); });
+        CHECK(received.empty());
+
+        CHECK(pair.a.send("next", 4) == 0);
+        received = pair.run(300, [](const std::string &) { return false; });
+        CHECK(received == std::vector<std::string>{"next"});
+        pair.check_idle();
+    }
+
+    void message_lost()
+    {
+        Pair pair;
+        std::string message(3 * mss, 'x');
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size()), 0, 100) == 0);
+        auto received = pair.run(300, [](const std::string &datagram) { return has(datagram, 'x'); });
+        CHECK(received.empty());
+
+        CHECK(pair.a.send("next", 4) == 0);
+        received = pair.run(300, [](const std::string &) { return false; });
+        CHECK(received == std::vector<std::string>{"next"});
+        pair.check_idle();
+    }
+
+    // the window is full of lost segments until the message has expired,
+    // so it is dropped from the send queue
+    void expired_unsent()
+    {
+        Pair pair;
+        std::string filler(mss, 'f');
+        for (int i = 0; i < static_cast<int>(KCP_WND_SND); i++)
+            CHECK(pair.a.send(filler.data(), mss) == 0);
+        std::string message(3 * mss, 'y');
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size()), 0, 100) == 0);
+        CHECK(pair.a.send("next", 4) == 0);
+        auto received = pair.run(300, [](const std::string &) { return true; });
+        CHECK(received.empty());
+
+        received = pair.run(3000, [](const std::string &) { return false; });
+        std::vector<std::string> expected(KCP_WND_SND, filler);
+        expected.push_back("next");
+        CHECK(received == expected);
+        pair.check_idle();
+    }
+}
+
+int main()
+{
+    middle_fragment_lost();
+    message_lost();
+    expired_unsent();
+    return stone_test::report("test_lifetime");
+}
@@ -0,0 +1,168 @@
+//=====================================================================
+//
+// test_multistream.cpp - independently ordered streams
+//
+// A message lost on one stream must not hold back a later one on
+// another stream, while without multistream it waits for the
+// retransmission. Over a lossy simulated network every stream arrives
+// intact and in order, and the send side byte counts go back to 0.
+//
+//=====================================================================
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    using Datagrams = std::vector<std::string>;
+
+    struct Pair
+    {
+        Kcpp a{1, nullptr}, b{1, nullptr};
+        Datagrams ab, ba;
+        uint32_t current = 0;
+
+        explicit Pair(bool multistream)
+        {
+            a.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ab.emplace_back(buf, len);
+                return len;
+            });
+            b.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ba.emplace_back(buf, len);
+                return len;
+            });
+            for (Kcpp *kcp : {&a, &b})
+            {
+                kcp->no_delay(1, 10, 2, true);
+                kcp->set_multistream(multistream);
+            }
+        }
+
+        static void deliver(Datagrams &datagrams, Kcpp &kcp)
+        {
+            for (auto &datagram : datagrams)
+                kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size()));
+            datagrams.clear();
+        }
+
+        void tick()
+        {
+            current += 10;
+            a.update(current);
+            b.update(current);
+        }
+
+        // tick until a sends, returns what it sent
+        Datagrams next_from_a()
+        {
+            for (int i = 0; i < 1000 && ab.empty(); i++)
+                tick();
+            Datagrams sent;
+            sent.swap(ab);
+            return sent;
+        }
+    };
+
+    // the first message is lost, the second one sent a tick later
+    void head_of_line(bool multistream)
+    {
+        Pair pair(multistream);
+        uint16_t first = multistream ? 1 : 0, second = multistream ? 2 : 0;
+        char buffer[64];
+
+        CHECK(pair.a.send("one", 3, first) == 0);
+        CHECK(pair.next_from_a().size() == 1); // dropped
+
+        CHECK(pair.a.send("two", 3, second) == 0);
+        Datagrams sent = pair.next_from_a();
+        CHECK(sent.size() == 1);
+        Pair::deliver(sent, pair.b);
+        if (multistream)
+        {
+            CHECK(pair.b.recv(buffer, sizeof(buffer), second) == 3);
+            CHECK(std::string(buffer, 3) == "two");
+        }
+        CHECK(pair.b.recv(buffer, sizeof(buffer), first) < 0);
+
+        // the retransmission releases the rest
+        for (int i = 0; i < 100; i++)
+        {
+            pair.tick();
+            Pair::deliver(pair.ab, pair.b);
+            Pair::deliver(pair.ba, pair.a);
+        }
+        CHECK(pair.b.recv(buffer, sizeof(buffer), first) == 3);
+        CHECK(std::string(buffer, 3) == "one");
+        if (!multistream)
+        {
+            CHECK(pair.b.recv(buffer, sizeof(buffer), second) == 3);
+            CHECK(std::string(buffer, 3) == "two");
+        }
+        CHECK(pair.a.queued_bytes() == 0 && pair.a.inflight_bytes() == 0);
+        CHECK(pair.b.buffered_bytes() == 0);
+    }
+
+    // messages of 1 to 3 fragments on three streams, 10% loss
+    void lossy()
+    {
+        const int streams = 3, count = 300;
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        for (Kcpp *kcp : {&kcp1, &kcp2})
+        {
+            kcp->no_delay(1, 10, 2, true);
+            kcp->set_multistream(true);
+        }
+        NetSimLink link;
+        link.loss_good = 0.1;
+        NetSim sim(1);
+        sim.attach(kcp1, kcp2, link, link);
+
+        auto message = [](int stream, int i) {
+            return std::string(1 + (i * 997) % 4000, static_cast<char>('a' + stream + i % 20));
+        };
+        sim.at(0, [&] {
+            for (int i = 0; i < count; i++)
+                for (uint16_t stream = 0; stream < streams; stream++)
+                {
+                    std::string text = message(stream, i);
+                    CHECK(kcp1.send(text.data(), static_cast<int>(text.size()), stream) == 0);
+                }
+        });
+
+        int received[streams] = {};
+        bool intact = true;
+        std::vector<char> buffer(8192);
+        sim.set_poll([&] {
+            for (uint16_t stream = 0; stream < streams; stream++)
+            {
+                int hr;
+                while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()), stream)) > 0)
+                    intact = intact && std::string(buffer.data(), hr) == message(stream, received[stream]++);
+            }
+        });
+        sim.run(60000);
+
+        CHECK(intact);
+        for (int stream = 0; stream < streams; stream++)
+            CHECK(received[stream] == count);
+        CHECK(sim.stats(0).lost > 0);
+        CHECK(kcp1.queued_bytes() == 0);
+        CHECK(kcp1.inflight_bytes() == 0);
+        CHECK(kcp2.buffered_bytes() == 0);
+    }
+}
+
+int main()
+{
+    head_of_line(true);
+    head_of_line(false);
+    lossy();
+    return stone_test::report("test_multistream");
+}
@@ -0,0 +1,157 @@
+//=====================================================================
+//
+// test_negotiation.cpp - KCP_CMD_OPTS over a lossy simulated network
+//
+// Both sides must end up with the same options in effect, stop sending
+// OPTS once they agree, and exchange data with them. Covered for
+// offers crossing each other, a client offering first to a server
+// that is configured later, and a server session created by the first
+// datagram it receives, as a demultiplexer would.
+//
+//=====================================================================
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    const uint8_t offered = KCP_OPT_COMPACT | KCP_OPT_WSCALE;
+
+    void offer(Kcpp &kcp)
+    {
+        kcp.set_compact(true);
+        kcp.set_wndscale(2);
+    }
+
+    // a session which may only come to life with its first datagram
+    class Session
+    {
+    public:
+        using Output = std::function<int(const char *buf, int len, Session *kcp, void *user)>;
+
+        Session(bool lazy, std::function<void(Kcpp &)> setup) : setup_(std::move(setup))
+        {
+            if (!lazy)
+                create();
+        }
+
+        void set_output(const Output &output)
+        {
+            output_ = output;
+        }
+        int input(const char *data, uint32_t size)
+        {
+            if (!kcp_)
+                create();
+            return kcp_->input(data, size);
+        }
+        void update(uint32_t current)
+        {
+            if (kcp_)
+                kcp_->update(current);
+        }
+        int32_t check(uint32_t current)
+        {
+            return kcp_ ? kcp_->check(current) : static_cast<int32_t>(current + 100);
+        }
+        Kcpp *kcp()
+        {
+            return kcp_.get();
+        }
+
+    private:
+        void create()
+        {
+            kcp_.reset(new Kcpp(0x11223344, nullptr));
+            kcp_->set_output([this](const char *buf, int len, Kcpp *, void *) { return output_(buf, len, this, nullptr); });
+            setup_(*kcp_);
+        }
+
+        std::function<void(Kcpp &)> setup_;
+        std::unique_ptr<Kcpp> kcp_;
+        Output output_;
+    };
+
+    enum Case
+    {
+        CROSSING,
+        CLIENT_FIRST,
+        SERVER_ON_FIRST_PACKET,
+    };
+
+    void run(Case which, uint64_t seed, double loss)
+    {
+        Session client(false, offer);
+        Session server(which == SERVER_ON_FIRST_PACKET, which == CLIENT_FIRST ? [](Kcpp &) {} : offer);
+
+        NetSimLink link;
+        link.delay_min = 20;
+        link.delay_max = 40;
+        link.loss_good = loss;
+        NetSim sim(seed);
+        sim.attach(client, server, link, link);
+        if (which == CLIENT_FIRST) // the client offer has been answered by then
+            sim.at(500, [&] { offer(*server.kcp()); });
+
+        // agreed well before 10s, then nothing but silence
+        sim.run(10000);
+        uint64_t sent[2] = {sim.stats(0).sent, sim.stats(1).sent};
+        sim.run(30000);
+        CHECK(server.kcp() != nullptr);
+        if (!server.kcp())
+            return;
+        CHECK(client.kcp()->options() == offered);
+        CHECK(server.kcp()->options() == offered);
+        CHECK(sim.stats(0).sent == sent[0]);
+        CHECK(sim.stats(1).sent == sent[1]);
+
+        // and data flows both ways with compact headers
+        const int count = 50;
+        int received[2] = {0, 0};
+        bool intact = true;
+        for (int i = 0; i < count; i++)
+        {
+            std::string message(100 + i, static_cast<char>('a' + i % 26));
+            client.kcp()->send(message.data(), static_cast<int>(message.size()));
+            server.kcp()->send(message.data(), static_cast<int>(message.size()));
+        }
+        sim.set_poll([&] {
+            Kcpp *kcps[2] = {server.kcp(), client.kcp()};
+            char buffer[256];
+            for (int side = 0; side < 2; side++)
+            {
+                int hr;
+                while ((hr = kcps[side]->recv(buffer, sizeof(buffer))) > 0)
+                {
+                    int i = received[side]++;
+                    intact = intact && hr == 100 + i && buffer[hr - 1] == static_cast<char>('a' + i % 26);
+                }
+            }
+        });
+        sim.run(60000);
+        CHECK(received[0] == count);
+        CHECK(received[1] == count);
+        CHECK(intact);
+    }
+}
+
+int main()
+{
+    for (Case which : {CROSSING, CLIENT_FIRST, SERVER_ON_FIRST_PACKET})
+    {
+        run(which, 1, 0);
+        for (uint64_t seed = 1; seed <= 20; seed++)
+        {
+            run(which, seed, 0.2);
+        }
+    }
+    return stone_test::report("test_negotiation");
+}
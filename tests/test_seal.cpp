@@ -0,0 +1,170 @@
+//=====================================================================
+//
+// test_seal.cpp - set_cipher() datagram sealing
+//
+// The XChaCha20-Poly1305 construction against the vectors of
+// draft-irtf-cfrg-xchacha, sealed sessions over a lossy simulated
+// network, distinct keystreams for sessions sharing a key, and
+// rejection of any altered, truncated or wrongly keyed datagram.
+//
+//=====================================================================
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "aead.h"
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    std::vector<uint8_t> hex(const char *text)
+    {
+        std::vector<uint8_t> out;
+        for (; text[0] && text[1]; text += 2)
+            out.push_back(static_cast<uint8_t>(std::stoi(std::string(text, 2), nullptr, 16)));
+        return out;
+    }
+
+    void vectors()
+    {
+        // 2.2.1, HChaCha20
+        uint8_t key[AEAD_KEY_LEN], subkey[AEAD_KEY_LEN];
+        for (int i = 0; i < AEAD_KEY_LEN; i++)
+            key[i] = static_cast<uint8_t>(i);
+        std::vector<uint8_t> nonce = hex("000000090000004a0000000031415927");
+        hchacha20(key, nonce.data(), subkey);
+        CHECK(std::vector<uint8_t>(subkey, subkey + AEAD_KEY_LEN) ==
+              hex("82413b4227b27bfed30e42508a877d73a0f9e4d58a74a853c12ec41326d3ecdc"));
+
+        // A.3.1, XChaCha20-Poly1305 as output() builds it
+        std::string text = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the "
+                           "future, sunscreen would be it.";
+        std::vector<uint8_t> ad = hex("50515253c0c1c2c3c4c5c6c7");
+        for (int i = 0; i < AEAD_KEY_LEN; i++)
+            key[i] = static_cast<uint8_t>(0x80 + i);
+        std::vector<uint8_t> xnonce = hex("404142434445464748494a4b4c4d4e4f5051525354555657");
+        uint8_t inner[AEAD_NONCE_LEN] = {0};
+        memcpy(inner + 4, xnonce.data() + HCHACHA_NONCE_LEN, 8);
+        hchacha20(key, xnonce.data(), subkey);
+
+        std::vector<char> data(text.begin(), text.end());
+        uint8_t tag[AEAD_TAG_LEN];
+        aead_seal(subkey, inner, reinterpret_cast<const char *>(ad.data()), static_cast<int>(ad.size()), data.data(),
+                  static_cast<int>(data.size()), tag);
+        std::vector<uint8_t> sealed(data.begin(), data.end());
+        sealed.insert(sealed.end(), tag, tag + AEAD_TAG_LEN);
+        CHECK(sealed == hex("bd6d179d3e83d43b9576579493c0e939572a1700252bfaccbed2902c21396cbb731c7f1b0b4aa6440bf3"
+                            "a82f4eda7e39ae64c6708c54c216cb96b72e1213b4522f8c9ba40db5d945b11b69b982c1bb9e3f3fac2bc"
+                            "369488f76b2383565d3fff921f9664c97637da9768812f615c68b13b52ec0875924c1c7987947deafd878"
+                            "0acf49"));
+    }
+
+    uint8_t key1[AEAD_KEY_LEN] = {1}, key2[AEAD_KEY_LEN] = {2};
+
+    void round_trip(uint64_t seed, double loss)
+    {
+        Kcpp kcp1(1, nullptr), kcp2(1, nullptr);
+        CHECK(kcp1.set_cipher(key1, key2));
+        CHECK(kcp2.set_cipher(key2, key1));
+        NetSimLink link;
+        link.loss_good = loss;
+        NetSim sim(seed);
+        sim.attach(kcp1, kcp2, link, link);
+
+        const int count = 300;
+        for (int i = 0; i < count; i++)
+        {
+            std::string text(1 + (i * 37) % 3000, static_cast<char>(i));
+            kcp1.send(text.data(), static_cast<int>(text.size()));
+        }
+        int received = 0;
+        bool intact = true;
+        std::vector<char> buffer(4096);
+        sim.set_poll([&] {
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                intact = intact && hr == 1 + (received * 37) % 3000 && buffer[hr - 1] == static_cast<char>(received);
+                received++;
+            }
+        });
+        sim.run(120000);
+        CHECK(received == count);
+        CHECK(intact);
+    }
+
+    // the datagrams of a session sending text once
+    std::vector<std::string> sealed_datagrams(const std::string &text)
+    {
+        std::vector<std::string> datagrams;
+        Kcpp kcp(1, nullptr);
+        kcp.set_cipher(key1, key2);
+        kcp.no_delay(1, 10, 2, true); // no cwnd, it is sent at once
+        kcp.set_output([&datagrams](const char *buf, int len, Kcpp *, void *) {
+            datagrams.emplace_back(buf, len);
+            return len;
+        });
+        kcp.send(text.data(), static_cast<int>(text.size()));
+        kcp.update(0);
+        kcp.flush();
+        return datagrams;
+    }
+
+    void shared_key()
+    {
+        // the same key, plaintext and nonce counter in both sessions
+        std::vector<std::string> a = sealed_datagrams("the same plaintext"), b = sealed_datagrams("the same plaintext");
+        CHECK(a.size() == 1 && b.size() == 1);
+        if (a.size() == 1 && b.size() == 1)
+        {
+            CHECK(a[0].size() == b[0].size());
+            CHECK(a[0].compare(0, KCP_OVERHEAD, b[0], 0, KCP_OVERHEAD) != 0);
+        }
+    }
+
+    void corruption()
+    {
+        std::string datagram = sealed_datagrams("a sealed message")[0];
+        Kcpp kcp(1, nullptr);
+        kcp.set_cipher(key2, key1);
+        kcp.set_output([](const char *, int len, Kcpp *, void *) { return len; });
+
+        for (size_t i = 0; i < datagram.size(); i++)
+        {
+            std::string altered = datagram;
+            altered[i] ^= 0x20;
+            CHECK(kcp.input(altered.data(), static_cast<uint32_t>(altered.size())) == -4);
+        }
+        CHECK(kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size()) - 1) == -4);
+        CHECK(kcp.input(datagram.data(), KCP_OVERHEAD + KCP_SEAL_OVERHEAD - 1) == -1);
+        CHECK(kcp.stats().datagrams_received == 0);
+        CHECK(kcp.peek_size() == -1);
+
+        Kcpp wrong(1, nullptr);
+        wrong.set_cipher(key2, key2);
+        CHECK(wrong.input(datagram.data(), static_cast<uint32_t>(datagram.size())) == -4);
+
+        // the intact one still opens afterwards
+        char buffer[64];
+        CHECK(kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size())) == 0);
+        CHECK(kcp.recv(buffer, sizeof(buffer)) == 16);
+        CHECK(memcmp(buffer, "a sealed message", 16) == 0);
+    }
+}
+
+int main()
+{
+    vectors();
+    for (uint64_t seed = 1; seed <= 5; seed++)
+    {
+        round_trip(seed, seed == 1 ? 0 : 0.1);
+    }
+    shared_key();
+    corruption();
+    return stone_test::report("test_seal");
+}
@@ -0,0 +1,106 @@
+//=====================================================================
+//
+// test_shm.cpp - ShmTransport rings
+//
+// Datagrams of every size go both ways through a segment in order,
+// wrapping around the ring many times. A peer that writes a record
+// length past the ring or past what it published breaks the transport
+// instead of having its reader run off the end of the segment.
+//
+//=====================================================================
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "shm_transport.h"
+
+using namespace stone;
+
+namespace
+{
+    std::string name()
+    {
+        return "/test_shm." + std::to_string(getpid());
+    }
+
+    void round_trip()
+    {
+        ShmTransport a, b;
+        CHECK(a.create(name(), 4096));
+        CHECK(b.attach(name()));
+
+        std::vector<char> buffer(4096);
+        bool intact = true;
+        for (int i = 0; i < 5000; i++)
+        {
+            std::string text(i % 1500, static_cast<char>(i));
+            ShmTransport &from = i % 2 ? a : b, &to = i % 2 ? b : a;
+            CHECK(from.send(text.data(), static_cast<int>(text.size())) == static_cast<int>(text.size()));
+            int hr = to.recv(buffer.data(), static_cast<int>(buffer.size()));
+            intact = intact && hr == static_cast<int>(text.size()) && memcmp(buffer.data(), text.data(), hr) == 0;
+            CHECK(to.recv(buffer.data(), static_cast<int>(buffer.size())) == -1);
+        }
+        CHECK(intact);
+
+        // a full ring drops, a small buffer drops the datagram
+        std::string big(1000, 'x');
+        int sent = 0;
+        while (a.send(big.data(), static_cast<int>(big.size())) > 0)
+            sent++;
+        CHECK(sent >= 3 && sent <= 4); // less one if the ring had to wrap
+        CHECK(b.recv(buffer.data(), 10) == -2);
+        CHECK(b.recv(buffer.data(), static_cast<int>(buffer.size())) == 1000);
+        CHECK(!a.broken() && !b.broken());
+    }
+
+    struct Sink
+    {
+        int input(const char *, uint32_t) { return 0; }
+    };
+
+    // the attacher reads what the creator's side of the segment says,
+    // patch the first record of that ring as a faulty peer would
+    void bad_record(uint32_t length, bool publish_all)
+    {
+        ShmTransport a, b;
+        CHECK(a.create(name(), 4096));
+        CHECK(b.attach(name()));
+        CHECK(a.send("hello", 5) == 5);
+
+        int fd = shm_open(name().c_str(), O_RDWR, 0600);
+        struct stat st;
+        fstat(fd, &st);
+        char *base = static_cast<char *>(mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+        ::close(fd);
+        ShmTransport::Ring *ring = reinterpret_cast<ShmTransport::Ring *>(base + alignof(ShmTransport::Ring));
+        memcpy(base + ring->offset, &length, sizeof(length));
+        if (publish_all)
+            ring->tail.store(ring->capacity);
+
+        char buffer[8192];
+        CHECK(b.recv(buffer, sizeof(buffer)) == -3);
+        CHECK(b.broken());
+        CHECK(b.recv(buffer, sizeof(buffer)) == -3);
+        CHECK(!b.wait(1000));
+        Sink sink;
+        CHECK(b.drain(sink) == 0);
+        munmap(base, st.st_size);
+    }
+}
+
+int main()
+{
+    round_trip();
+    bad_record(1u << 20, true);  // past the end of the ring
+    bad_record(4093, true);      // longer than what is left of the ring
+    bad_record(1000, false);     // past what was published
+    bad_record(0xfffffff0, true); // would wrap the size checks
+    return stone_test::report("test_shm");
+}
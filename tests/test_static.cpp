@@ -0,0 +1,120 @@
+//=====================================================================
+//
+// test_static.cpp - BasicKcpp with a KcpStaticConfig
+//
+// KcppFast sends exactly the datagrams of a Kcpp set up the same way
+// at run time, keeps its fixed values through the setters, and moves
+// a transfer larger than its windows through a lossy simulated
+// network intact and in order.
+//
+//=====================================================================
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    std::string message(int i)
+    {
+        return std::string(1 + (i * 389) % 5000, static_cast<char>(i));
+    }
+
+    // every datagram of a session sending to nobody for 3s, resends included
+    template <typename K>
+    std::vector<std::string> script(K &kcp)
+    {
+        std::vector<std::string> datagrams;
+        kcp.set_output([&datagrams](const char *buf, int len, K *, void *) {
+            datagrams.emplace_back(buf, len);
+            return len;
+        });
+        for (int i = 0; i < 100; i++)
+        {
+            std::string text = message(i);
+            kcp.send(text.data(), static_cast<int>(text.size()));
+        }
+        for (uint32_t current = 0; current < 3000; current += 10)
+        {
+            kcp.update(current);
+        }
+        return datagrams;
+    }
+
+    void same_wire()
+    {
+        Kcpp runtime(7, nullptr);
+        runtime.no_delay(1, 10, 2, true);
+        runtime.set_wndsize(128, 128);
+        KcppFast fixed(7, nullptr);
+        fixed.no_delay(1, 10, 2, true);
+
+        std::vector<std::string> a = script(runtime), b = script(fixed);
+        CHECK(!a.empty());
+        CHECK(a == b);
+    }
+
+    void setters()
+    {
+        KcppFast kcp(7, nullptr);
+        CHECK(kcp.set_mtu(KCP_MTU_DEF));
+        CHECK(!kcp.set_mtu(576));
+        kcp.set_wndsize(32, 32);
+        kcp.no_delay(0, 40, 0, false);
+        std::vector<std::string> datagrams = script(kcp);
+        // still 128 segments unacked in flight with no cwnd
+        CHECK(datagrams.size() >= 128);
+        for (const std::string &datagram : datagrams)
+            CHECK(datagram.size() <= KCP_MTU_DEF);
+    }
+
+    void round_trip(uint64_t seed)
+    {
+        KcppFast kcp1(1, nullptr), kcp2(1, nullptr);
+        for (KcppFast *kcp : {&kcp1, &kcp2})
+            kcp->no_delay(1, 10, 2, true);
+        NetSimLink link;
+        link.delay_min = 10;
+        link.delay_max = 30;
+        link.loss_good = 0.1;
+        NetSim sim(seed);
+        sim.attach(kcp1, kcp2, link, link);
+
+        const int count = 500;
+        for (int i = 0; i < count; i++)
+        {
+            std::string text = message(i);
+            CHECK(kcp1.send(text.data(), static_cast<int>(text.size())) == 0);
+        }
+        int received = 0;
+        bool intact = true;
+        std::vector<char> buffer(8192);
+        sim.set_poll([&] {
+            int hr;
+            while ((hr = kcp2.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+            {
+                intact = intact && std::string(buffer.data(), hr) == message(received);
+                received++;
+            }
+        });
+        sim.run(120000);
+        CHECK(received == count);
+        CHECK(intact);
+    }
+}
+
+int main()
+{
+    same_wire();
+    setters();
+    for (uint64_t seed = 1; seed <= 5; seed++)
+    {
+        round_trip(seed);
+    }
+    return stone_test::report("test_static");
+}
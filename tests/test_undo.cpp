@@ -0,0 +1,139 @@
+//=====================================================================
+//
+// test_undo.cpp - undoing the cwnd reduction of spurious retransmissions
+//
+// One segment is sent after a warm up which grows the cwnd, and its
+// transmissions are delivered, held back or dropped by hand. An ack of
+// the original transmission arriving after the retransmission must
+// restore the window. An ack of a needed retransmission must not, even
+// once a later retransmission has gone out: the session must end up as
+// it does with set_undo(false).
+//
+//=====================================================================
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    using Datagrams = std::vector<std::string>;
+
+    struct Pair
+    {
+        Kcpp a{1, nullptr}, b{1, nullptr};
+        Datagrams ab, ba;
+        uint32_t current = 0;
+
+        explicit Pair(bool undo)
+        {
+            a.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ab.emplace_back(buf, len);
+                return len;
+            });
+            b.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ba.emplace_back(buf, len);
+                return len;
+            });
+            a.no_delay(1, 10, 0, false);
+            b.no_delay(1, 10, 0, false);
+            a.set_undo(undo);
+        }
+
+        static void deliver(Datagrams &datagrams, Kcpp &kcp)
+        {
+            for (auto &datagram : datagrams)
+                kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size()));
+            datagrams.clear();
+        }
+
+        void tick()
+        {
+            current += 10;
+            a.update(current);
+            b.update(current);
+        }
+
+        // lossless traffic until the cwnd has grown past its start
+        void warm_up()
+        {
+            char buffer[1024];
+            for (int i = 0; i < 400; i++)
+            {
+                if (i < 200)
+                    a.send(buffer, 500);
+                tick();
+                deliver(ab, b);
+                deliver(ba, a);
+                while (b.recv(buffer, sizeof(buffer)) > 0)
+                    ;
+            }
+            CHECK(a.wait_send_size() == 0);
+            CHECK(a.stats().cwnd > 2);
+        }
+
+        // tick until a sends, returns what it sent
+        Datagrams next_from_a()
+        {
+            for (int i = 0; i < 1000 && ab.empty(); i++)
+                tick();
+            Datagrams sent;
+            sent.swap(ab);
+            return sent;
+        }
+    };
+
+    // the original is delayed, not lost: its ack arrives after the resend
+    void spurious(bool undo, KcpStats &stats)
+    {
+        Pair pair(undo);
+        pair.warm_up();
+        pair.a.send("x", 1);
+        Datagrams original = pair.next_from_a();
+        Datagrams resent = pair.next_from_a(); // dropped
+        CHECK(original.size() == 1 && resent.size() == 1);
+        Pair::deliver(original, pair.b);
+        pair.tick();
+        Pair::deliver(pair.ba, pair.a);
+        CHECK(pair.a.wait_send_size() == 0);
+        stats = pair.a.stats();
+    }
+
+    // the original and the second transmission are lost, the first
+    // retransmission is acked after the third transmission went out
+    void needed(bool undo, KcpStats &stats)
+    {
+        Pair pair(undo);
+        pair.warm_up();
+        pair.a.send("x", 1);
+        pair.next_from_a(); // dropped
+        Datagrams resent = pair.next_from_a();
+        CHECK(resent.size() == 1);
+        Pair::deliver(resent, pair.b);
+        pair.tick();
+        Datagrams ack;
+        ack.swap(pair.ba);
+        pair.next_from_a(); // dropped
+        Pair::deliver(ack, pair.a);
+        CHECK(pair.a.wait_send_size() == 0);
+        stats = pair.a.stats();
+    }
+}
+
+int main()
+{
+    KcpStats with, without;
+    spurious(true, with);
+    spurious(false, without);
+    CHECK(with.cwnd > without.cwnd);
+
+    needed(true, with);
+    needed(false, without);
+    CHECK(with.cwnd == without.cwnd);
+    CHECK(with.ssthresh == without.ssthresh);
+    return stone_test::report("test_undo");
+}
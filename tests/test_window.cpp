@@ -0,0 +1,155 @@
+//=====================================================================
+//
+// test_window.cpp - the windows the two sides advertise each other
+//
+// A message may have as many fragments as the remote's window holds: a
+// sender with a large window must not send one the remote, on the
+// default window, can never reassemble, and one which fits once the
+// remote has advertised a large window must arrive. A receiver whose
+// scaled window has been advertised as 0 must tell the sender as soon
+// as recv() frees enough of it, not leave it to the window probe.
+//
+//=====================================================================
+
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "kcpp.h"
+
+using namespace stone;
+
+namespace
+{
+    using Datagrams = std::vector<std::string>;
+
+    const int mss = static_cast<int>(KCP_MTU_DEF - KCP_OVERHEAD);
+
+    struct Pair
+    {
+        Kcpp a{1, nullptr}, b{1, nullptr};
+        Datagrams ab, ba;
+        uint32_t current = 0;
+
+        Pair()
+        {
+            a.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ab.emplace_back(buf, len);
+                return len;
+            });
+            b.set_output([this](const char *buf, int len, Kcpp *, void *) {
+                ba.emplace_back(buf, len);
+                return len;
+            });
+            a.no_delay(1, 10, 2, true);
+            b.no_delay(1, 10, 2, true);
+        }
+
+        static void deliver(Datagrams &datagrams, Kcpp &kcp)
+        {
+            for (auto &datagram : datagrams)
+                kcp.input(datagram.data(), static_cast<uint32_t>(datagram.size()));
+            datagrams.clear();
+        }
+
+        void tick()
+        {
+            current += 10;
+            a.update(current);
+            b.update(current);
+            deliver(ab, b);
+            deliver(ba, a);
+        }
+
+        // the messages b receives in ticks
+        std::vector<int> run(int ticks)
+        {
+            std::vector<int> received;
+            std::vector<char> buffer(1 << 20);
+            for (int i = 0; i < ticks; i++)
+            {
+                tick();
+                int hr;
+                while ((hr = b.recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+                    received.push_back(hr);
+            }
+            return received;
+        }
+    };
+
+    // the remote keeps the default window
+    void small_remote()
+    {
+        Pair pair;
+        pair.a.set_wndsize(1024, 1024);
+        std::vector<char> message(200 * mss);
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size())) == -2);
+        CHECK(pair.a.send("x", 1) == 0);
+        CHECK(pair.run(50) == std::vector<int>{1});
+        // it has advertised its window, which is still too small
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size())) == -2);
+        CHECK(pair.a.send(message.data(), 100 * mss) == 0);
+        CHECK(pair.run(200) == std::vector<int>{100 * mss});
+        CHECK(pair.a.wait_send_size() == 0);
+    }
+
+    // both sides have large windows
+    void large_remote()
+    {
+        Pair pair;
+        pair.a.set_wndsize(1024, 1024);
+        pair.b.set_wndsize(1024, 1024);
+        CHECK(pair.a.send("x", 1) == 0);
+        CHECK(pair.run(50) == std::vector<int>{1});
+        std::vector<char> message(200 * mss);
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size())) == 0);
+        CHECK(pair.run(200) == std::vector<int>{200 * mss});
+        CHECK(pair.a.wait_send_size() == 0);
+        // frg is 8 bits
+        message.resize(300 * mss);
+        CHECK(pair.a.send(message.data(), static_cast<int>(message.size())) == -2);
+    }
+
+    // wscale 8: the window is advertised in units of 256 segments
+    void slow_reader()
+    {
+        Pair pair;
+        for (Kcpp *kcp : {&pair.a, &pair.b})
+        {
+            kcp->set_wndsize(4096, 4096);
+            CHECK(kcp->set_wndscale(8));
+        }
+        std::vector<char> message(mss);
+        for (int i = 0; i < 6000; i++)
+            pair.a.send(message.data(), mss);
+        // nothing is read until the sender stalls on the zero window
+        for (int i = 0; i < 100; i++)
+            pair.tick();
+        int waiting = pair.a.wait_send_size();
+        CHECK(waiting == 6000 - 4096);
+        pair.tick();
+        CHECK(pair.a.wait_send_size() == waiting);
+
+        // 100 free slots are still advertised as 0
+        for (int i = 0; i < 100; i++)
+            CHECK(pair.b.recv(message.data(), mss) == mss);
+        for (int i = 0; i < 10; i++)
+            pair.tick();
+        CHECK(pair.a.wait_send_size() == waiting);
+
+        // 290 free: the window goes from 0 to 256
+        for (int i = 0; i < 190; i++)
+            CHECK(pair.b.recv(message.data(), mss) == mss);
+        for (int i = 0; i < 10; i++)
+            pair.tick();
+        CHECK(pair.a.wait_send_size() <= waiting - 256);
+    }
+}
+
+int main()
+{
+    small_remote();
+    large_remote();
+    slow_reader();
+    return stone_test::report("test_window");
+}
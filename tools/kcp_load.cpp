@@ -0,0 +1,374 @@
+//=====================================================================
+//
+// kcp_load.cpp - many sessions over real UDP sockets
+//
+// Opens N client sessions spread over a few UDP sockets, each sending
+// messages at a fixed rate to an echo server, by default in the same
+// process on 127.0.0.1. Sessions are told apart by conv. At the end it
+// prints the aggregate throughput, the rtt percentiles of all messages,
+// the spread of per session percentiles and the cpu used, to find where
+// a single process stops keeping up.
+//
+//   kcp_load [--sessions N] [--size BYTES] [--rate MSG/S] [--mode 0|1|2]
+//            [--wnd N] [--duration S] [--sockets N] [--port P]
+//            [--server] [--connect IPV4:PORT]
+//
+// --server only echoes on --port, until killed, and --connect runs the
+// clients against such a process. Every socket is bound to 127.0.0.1.
+// Single threaded, POSIX only.
+//
+//=====================================================================
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "kcpp.h"
+#include "wire.h"
+
+using namespace stone;
+
+namespace
+{
+    struct Options
+    {
+        uint32_t sessions = 1000;
+        int size = 64;
+        double rate = 10;
+        int mode = 2;
+        int wnd = 128;
+        double duration = 10;
+        uint32_t sockets = 16;
+        uint16_t port = 0;
+        bool server = true, client = true;
+        sockaddr_in remote = {};
+    };
+
+    struct Session
+    {
+        std::unique_ptr<Kcpp> kcp;
+        int fd = -1;
+        sockaddr_in peer = {};
+        uint32_t next_update = 0; // ms
+        uint64_t next_send = 0;   // us
+        uint64_t sent = 0, received = 0;
+        std::vector<uint32_t> rtts; // us
+    };
+
+    uint64_t now_us()
+    {
+        using namespace std::chrono;
+        return static_cast<uint64_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+    }
+
+    double cpu_seconds()
+    {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+               (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+
+    int open_socket(uint16_t port)
+    {
+        int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+            return -1;
+        int size = 8 << 20;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void setup(Kcpp &kcp, const Options &options)
+    {
+        kcp.set_wndsize(options.wnd, options.wnd);
+        if (options.mode == 0)
+            kcp.no_delay(0, 10, 0, false);
+        else if (options.mode == 1)
+            kcp.no_delay(0, 10, 0, true);
+        else
+            kcp.no_delay(2, 10, 2, true);
+    }
+
+    Session *make_session(uint32_t conv, int fd, const sockaddr_in &peer, const Options &options)
+    {
+        Session *session = new Session();
+        session->fd = fd;
+        session->peer = peer;
+        session->kcp.reset(new Kcpp(conv, session));
+        session->kcp->set_output([](const char *buf, int len, Kcpp *, void *user) {
+            Session *s = static_cast<Session *>(user);
+            sendto(s->fd, buf, len, 0, reinterpret_cast<const sockaddr *>(&s->peer), sizeof(s->peer));
+            return len;
+        });
+        setup(*session->kcp, options);
+        return session;
+    }
+
+    double percentile(std::vector<uint32_t> &values, double p)
+    {
+        if (values.empty())
+            return -1;
+        size_t i = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+        std::nth_element(values.begin(), values.begin() + i, values.end());
+        return values[i] / 1e3;
+    }
+
+    bool parse(int argc, char *argv[], Options &options)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            const char *opt = argv[i];
+            if (strcmp(opt, "--server") == 0)
+            {
+                options.client = false;
+                continue;
+            }
+            if (i + 1 >= argc)
+                return false;
+            const char *arg = argv[++i];
+            if (strcmp(opt, "--sessions") == 0)
+                options.sessions = static_cast<uint32_t>(atoi(arg));
+            else if (strcmp(opt, "--size") == 0)
+                options.size = std::max(12, atoi(arg));
+            else if (strcmp(opt, "--rate") == 0)
+                options.rate = atof(arg);
+            else if (strcmp(opt, "--mode") == 0)
+                options.mode = atoi(arg);
+            else if (strcmp(opt, "--wnd") == 0)
+                options.wnd = atoi(arg);
+            else if (strcmp(opt, "--duration") == 0)
+                options.duration = atof(arg);
+            else if (strcmp(opt, "--sockets") == 0)
+                options.sockets = std::max(1, atoi(arg));
+            else if (strcmp(opt, "--port") == 0)
+                options.port = static_cast<uint16_t>(atoi(arg));
+            else if (strcmp(opt, "--connect") == 0)
+            {
+                std::string addr(arg);
+                size_t colon = addr.rfind(':');
+                if (colon == std::string::npos)
+                    return false;
+                options.remote.sin_family = AF_INET;
+                options.remote.sin_port = htons(static_cast<uint16_t>(atoi(addr.c_str() + colon + 1)));
+                if (inet_pton(AF_INET, addr.substr(0, colon).c_str(), &options.remote.sin_addr) != 1)
+                    return false;
+                options.server = false;
+            }
+            else
+                return false;
+        }
+        return options.server || options.client;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parse(argc, argv, options))
+    {
+        fprintf(stderr, "usage: see the top of kcp_load.cpp\n");
+        return 2;
+    }
+
+    // the echo side: one socket, a session per conv created on demand
+    int server_fd = -1;
+    std::unordered_map<uint32_t, std::unique_ptr<Session>> servers;
+    if (options.server)
+    {
+        server_fd = open_socket(options.port);
+        if (server_fd < 0)
+        {
+            perror("server socket");
+            return 1;
+        }
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getsockname(server_fd, reinterpret_cast<sockaddr *>(&addr), &len);
+        if (options.client)
+            options.remote = addr;
+        fprintf(stderr, "echo on 127.0.0.1:%u\n", ntohs(addr.sin_port));
+    }
+
+    // the load side: sessions round robin over the sockets, conv 1..N
+    std::vector<int> client_fds;
+    std::vector<std::unique_ptr<Session>> clients;
+    std::mt19937 rng(1);
+    uint64_t start = now_us();
+    uint64_t period = options.rate > 0 ? static_cast<uint64_t>(1e6 / options.rate) : 0;
+    if (options.client)
+    {
+        for (uint32_t i = 0; i < std::min(options.sockets, options.sessions); i++)
+        {
+            int fd = open_socket(0);
+            if (fd < 0)
+            {
+                perror("client socket");
+                return 1;
+            }
+            client_fds.push_back(fd);
+        }
+        for (uint32_t i = 0; i < options.sessions; i++)
+        {
+            clients.emplace_back(make_session(i + 1, client_fds[i % client_fds.size()], options.remote, options));
+            clients.back()->next_send = start + (period > 0 ? rng() % period : 0);
+        }
+    }
+
+    std::vector<pollfd> fds;
+    if (server_fd >= 0)
+        fds.push_back({server_fd, POLLIN, 0});
+    for (int fd : client_fds)
+        fds.push_back({fd, POLLIN, 0});
+
+    std::vector<char> message(options.size, 'x'), buffer(64 * 1024);
+    uint64_t end = start + static_cast<uint64_t>(options.duration * 1e6);
+    double cpu0 = cpu_seconds();
+    uint64_t datagrams = 0;
+
+    auto serve = [&](Session &session) {
+        int hr;
+        while ((hr = session.kcp->recv(buffer.data(), static_cast<int>(buffer.size()))) > 0)
+        {
+            session.kcp->send(buffer.data(), hr);
+            session.received++;
+        }
+    };
+    auto collect = [&](Session &session, uint64_t now) {
+        int hr;
+        while ((hr = session.kcp->recv(buffer.data(), static_cast<int>(buffer.size()))) >= 12)
+        {
+            uint64_t sent;
+            memcpy(&sent, buffer.data() + 4, 8);
+            session.rtts.push_back(static_cast<uint32_t>(now - sent));
+            session.received++;
+        }
+    };
+
+    // the clients stop sending at the end, the echo side runs until killed
+    while (!options.client || now_us() < end)
+    {
+        poll(fds.data(), fds.size(), 1);
+        uint64_t now = now_us();
+        uint32_t ms = static_cast<uint32_t>((now - start) / 1000);
+
+        for (const pollfd &p : fds)
+        {
+            if (!(p.revents & POLLIN))
+                continue;
+            while (true)
+            {
+                sockaddr_in from;
+                socklen_t len = sizeof(from);
+                ssize_t size = recvfrom(p.fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr *>(&from), &len);
+                if (size < static_cast<ssize_t>(KCP_OVERHEAD))
+                {
+                    if (size < 0)
+                        break;
+                    continue;
+                }
+                datagrams++;
+                uint32_t conv = wire_load32(buffer.data());
+                if (p.fd == server_fd)
+                {
+                    auto &session = servers[conv];
+                    if (!session)
+                    {
+                        session.reset(make_session(conv, server_fd, from, options));
+                        session->kcp->update(ms);
+                    }
+                    session->peer = from;
+                    session->kcp->input(buffer.data(), static_cast<uint32_t>(size));
+                    serve(*session);
+                }
+                else if (conv >= 1 && conv <= clients.size())
+                {
+                    Session &session = *clients[conv - 1];
+                    session.kcp->input(buffer.data(), static_cast<uint32_t>(size));
+                    collect(session, now);
+                }
+            }
+        }
+
+        for (auto &session : clients)
+        {
+            while (period > 0 && session->next_send <= now && now < end)
+            {
+                uint32_t index = static_cast<uint32_t>(session->sent++);
+                memcpy(message.data(), &index, 4);
+                memcpy(message.data() + 4, &now, 8);
+                session->kcp->send(message.data(), options.size);
+                session->next_send += period;
+            }
+            if (static_cast<int32_t>(ms - session->next_update) >= 0)
+            {
+                session->kcp->update(ms);
+                session->next_update = static_cast<uint32_t>(session->kcp->check(ms));
+            }
+        }
+        for (auto &entry : servers)
+        {
+            Session &session = *entry.second;
+            if (static_cast<int32_t>(ms - session.next_update) >= 0)
+            {
+                session.kcp->update(ms);
+                session.next_update = static_cast<uint32_t>(session.kcp->check(ms));
+            }
+        }
+    }
+
+    double wall = (now_us() - start) / 1e6;
+    double cpu = cpu_seconds() - cpu0;
+
+    std::vector<uint32_t> all, p50s, p99s;
+    uint64_t sent = 0, received = 0;
+    for (auto &session : clients)
+    {
+        sent += session->sent;
+        received += session->received;
+        all.insert(all.end(), session->rtts.begin(), session->rtts.end());
+        if (!session->rtts.empty())
+        {
+            p50s.push_back(static_cast<uint32_t>(percentile(session->rtts, 0.5) * 1e3));
+            p99s.push_back(static_cast<uint32_t>(percentile(session->rtts, 0.99) * 1e3));
+        }
+    }
+    printf("load sessions=%u size=%d rate=%.1f mode=%d sockets=%zu wall_s=%.1f cpu_pct=%.1f datagrams_in=%llu\n",
+           options.sessions, options.size, options.rate, options.mode, client_fds.size(), wall, cpu * 100 / wall,
+           static_cast<unsigned long long>(datagrams));
+    printf("load sent=%llu echoed=%llu msgs_per_s=%.0f mbps=%.2f\n", static_cast<unsigned long long>(sent),
+           static_cast<unsigned long long>(received), received / wall, received * options.size / wall / 1e6);
+    printf("load rtt_ms p50=%.2f p99=%.2f p999=%.2f\n", percentile(all, 0.5), percentile(all, 0.99),
+           percentile(all, 0.999));
+    // per session percentiles: the median session and the worst one
+    double p99_max = p99s.empty() ? -1 : *std::max_element(p99s.begin(), p99s.end()) / 1e3;
+    printf("load session_rtt_ms p50_median=%.2f p99_median=%.2f p99_max=%.2f sessions_heard=%zu\n",
+           percentile(p50s, 0.5), percentile(p99s, 0.5), p99_max, p99s.size());
+    return 0;
+}
@@ -0,0 +1,186 @@
+//=====================================================================
+//
+// kcp_sim.cpp - the echo test of test.cpp on a simulated network
+//
+// kcp1 sends an 8 byte message every 20ms and kcp2 echoes it back, as
+// in test.cpp, but over NetSim on a virtual clock. Each run prints the
+// rtt of the first 1000 echoes and the datagrams sent; several seeds
+// give a spread in well under a second.
+//
+//   kcp_sim [--mode 0|1|2] [--seed N] [--runs N] [--delay MIN,MAX]
+//           [--loss P] [--burst TO_BAD,TO_GOOD,LOSS_BAD] [--bw BYTES/S]
+//           [--queue N] [--reorder P] [--dup P]
+//
+// --loss is the loss chance of the good state, --burst enables the
+// Gilbert-Elliott bad state. Chances are per datagram and direction.
+//
+//=====================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "kcpp.h"
+#include "netsim.h"
+
+using namespace stone;
+
+namespace
+{
+    struct Result
+    {
+        uint32_t time = 0; // simulated ms to the last echo
+        uint32_t count = 0;
+        int64_t sumrtt = 0;
+        uint32_t maxrtt = 0;
+        uint64_t tx = 0;
+        bool ordered = true;
+    };
+
+    void setup(Kcpp &kcp, int mode, bool sender)
+    {
+        kcp.set_wndsize(128, 128);
+        if (mode == 0)
+        {
+            kcp.no_delay(0, 10, 0, false);
+        }
+        else if (mode == 1)
+        {
+            kcp.no_delay(0, 10, 0, true);
+        }
+        else
+        {
+            kcp.no_delay(2, 10, 2, true);
+            if (sender)
+            {
+                kcp.set_minrto(10);
+                kcp.set_fastresend(1);
+            }
+        }
+    }
+
+    Result run(int mode, uint64_t seed, const NetSimLink &link)
+    {
+        Kcpp kcp1(0x11223344, nullptr), kcp2(0x11223344, nullptr);
+        setup(kcp1, mode, true);
+        setup(kcp2, mode, false);
+
+        NetSim sim(seed);
+        sim.attach(kcp1, kcp2, link, link);
+
+        Result result;
+        uint32_t index = 0;
+        std::function<void()> tick = [&] {
+            char buffer[8];
+            uint32_t now = sim.now();
+            memcpy(buffer, &index, 4);
+            memcpy(buffer + 4, &now, 4);
+            index++;
+            kcp1.send(buffer, 8);
+            sim.at(now + 20, tick);
+        };
+        sim.at(0, tick);
+
+        sim.set_poll([&] {
+            char buffer[2000];
+            int hr;
+            while ((hr = kcp2.recv(buffer, 10)) > 0)
+            {
+                kcp2.send(buffer, hr);
+            }
+            while ((hr = kcp1.recv(buffer, 10)) > 0)
+            {
+                uint32_t sn, ts;
+                memcpy(&sn, buffer, 4);
+                memcpy(&ts, buffer + 4, 4);
+                uint32_t rtt = sim.now() - ts;
+                if (sn != result.count)
+                    result.ordered = false;
+                result.count++;
+                result.sumrtt += rtt;
+                if (rtt > result.maxrtt)
+                    result.maxrtt = rtt;
+                if (result.count > 1000)
+                    sim.stop();
+            }
+        });
+
+        sim.run(3600 * 1000);
+        result.time = sim.now();
+        result.tx = sim.stats(0).sent;
+        return result;
+    }
+
+    bool parse_list(const char *arg, double *values, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            char *end;
+            values[i] = strtod(arg, &end);
+            if (end == arg || (i + 1 < count && *end != ','))
+                return false;
+            arg = end + 1;
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int mode = 2;
+    uint64_t seed = 1;
+    int runs = 1;
+    NetSimLink link;
+    // test.cpp: 10% round trip loss, rtt 60-125ms
+    link.delay_min = 30;
+    link.delay_max = 62;
+    link.loss_good = 0.05;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const char *opt = argv[i], *arg = argv[i + 1];
+        double v[3];
+        if (strcmp(opt, "--mode") == 0)
+            mode = atoi(arg);
+        else if (strcmp(opt, "--seed") == 0)
+            seed = strtoull(arg, nullptr, 10);
+        else if (strcmp(opt, "--runs") == 0)
+            runs = atoi(arg);
+        else if (strcmp(opt, "--delay") == 0 && parse_list(arg, v, 2))
+            link.delay_min = static_cast<uint32_t>(v[0]), link.delay_max = static_cast<uint32_t>(v[1]);
+        else if (strcmp(opt, "--loss") == 0)
+            link.loss_good = atof(arg);
+        else if (strcmp(opt, "--burst") == 0 && parse_list(arg, v, 3))
+            link.good_to_bad = v[0], link.bad_to_good = v[1], link.loss_bad = v[2];
+        else if (strcmp(opt, "--bw") == 0)
+            link.bandwidth = strtoull(arg, nullptr, 10);
+        else if (strcmp(opt, "--queue") == 0)
+            link.queue = static_cast<uint32_t>(atoi(arg));
+        else if (strcmp(opt, "--reorder") == 0)
+            link.reorder = atof(arg);
+        else if (strcmp(opt, "--dup") == 0)
+            link.duplicate = atof(arg);
+        else
+        {
+            fprintf(stderr, "bad option %s %s\n", opt, arg);
+            return 2;
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t simulated = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        Result result = run(mode, seed + i, link);
+        simulated += result.time;
+        printf("sim mode=%d seed=%llu time=%u avgrtt=%d maxrtt=%u tx=%llu%s\n", mode,
+               static_cast<unsigned long long>(seed + i), result.time,
+               result.count > 0 ? static_cast<int>(result.sumrtt / result.count) : -1, result.maxrtt,
+               static_cast<unsigned long long>(result.tx), result.ordered ? "" : " ERROR out of order");
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("sim runs=%d simulated_s=%.1f wall_s=%.3f speedup=%.0f\n", runs, simulated / 1e3, wall,
+           simulated / 1e3 / wall);
+    return 0;
+}
@@ -0,0 +1,60 @@
+//=====================================================================
+//
+// kcp_trace.cpp - print a trace dump
+//
+// Reads a file written by KcpTrace::save() and prints its events oldest
+// first, one line each, or as a JSON array with --json.
+//
+//   kcp_trace [--json] trace.bin
+//
+//=====================================================================
+
+#include <cstdio>
+#include <cstring>
+
+#include "trace.h"
+
+using namespace stone;
+
+int main(int argc, char *argv[])
+{
+    bool json = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--json") == 0)
+            json = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        fprintf(stderr, "usage: %s [--json] trace.bin\n", argv[0]);
+        return 2;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        perror(path);
+        return 1;
+    }
+    uint32_t conv = 0;
+    uint64_t lost = 0;
+    std::unique_ptr<KcpTraceEvent[]> events;
+    size_t count = 0;
+    bool ok = kcp_trace_load(file, conv, lost, events, count);
+    fclose(file);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: not a kcp trace\n", path);
+        return 1;
+    }
+
+    if (!json)
+    {
+        printf("# conv=%u events=%zu lost=%llu\n", conv, count, static_cast<unsigned long long>(lost));
+    }
+    kcp_trace_print(stdout, events.get(), count, json);
+    return 0;
+}
@@ -9,10 +9,207 @@ FilePath: /CPP/kcpp/xmake.lua
 --]]
 add_rules("mode.debug", "mode.release")
 
+-- shm_open() lives in librt before glibc 2.34
+if is_plat("linux") then
+    add_syslinks("rt")
+end
+
 target("kcpp")
     set_kind("binary")
     add_files("src/*.cpp")
 
+target("bench_bdp")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_bdp.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_compress")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_compress.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_seal")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_seal.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_crc")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_crc.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_wire")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_wire.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_shm")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_shm.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_zerocopy")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_zerocopy.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_idle")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_idle.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_profile")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_profile.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_defines("KCP_PROFILE=1")
+
+target("bench_suite")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_suite.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("bench_micro")
+    set_kind("binary")
+    set_default(false)
+    add_files("bench/bench_micro.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+-- ikcp.c and ikcp.h from https://github.com/skywind3000/kcp, not shipped
+if os.isfile("third_party/ikcp/ikcp.c") then
+    target("bench_ikcp")
+        set_kind("binary")
+        set_default(false)
+        add_files("bench/bench_ikcp.cpp", "src/*.cpp|test.cpp", "third_party/ikcp/ikcp.c")
+        add_includedirs("src", "third_party/ikcp")
+end
+
+target("kcp_trace")
+    set_kind("binary")
+    set_default(false)
+    add_files("tools/kcp_trace.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+target("kcp_sim")
+    set_kind("binary")
+    set_default(false)
+    add_files("tools/kcp_sim.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+
+if not is_plat("windows") then
+    target("kcp_load")
+        set_kind("binary")
+        set_default(false)
+        add_files("tools/kcp_load.cpp", "src/*.cpp|test.cpp")
+        add_includedirs("src")
+end
+
+-- pass/fail tests, xmake test runs them all
+target("test_negotiation")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_negotiation.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_compress")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_compress.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_seal")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_seal.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_crc")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_crc.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_static")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_static.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_clock")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_clock.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_undo")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_undo.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_window")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_window.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_multistream")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_multistream.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_lifetime")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_lifetime.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+target("test_autotune")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/test_autotune.cpp", "src/*.cpp|test.cpp")
+    add_includedirs("src")
+    add_tests("default")
+
+if is_plat("linux") then
+    target("test_shm")
+        set_kind("binary")
+        set_default(false)
+        add_files("tests/test_shm.cpp", "src/*.cpp|test.cpp")
+        add_includedirs("src")
+        add_tests("default")
+end
+
+if not is_plat("windows") then
+    target("test_file")
+        set_kind("binary")
+        set_default(false)
+        add_files("tests/test_file.cpp", "src/*.cpp|test.cpp")
+        add_includedirs("src")
+        add_tests("default")
+end
+
 --
 -- If you want to known more usage about xmake, please see https://xmake.io
 --